@@ -0,0 +1,121 @@
+#include "arena.hpp"
+#include "memory.hpp"
+
+void* Arena::allocate(int size, int alignment) {
+    verify(size >= 0);
+    verify(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    if (current) {
+        int offset = (current->used + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= current->capacity) {
+            current->used = offset + size;
+            return (char*)(current + 1) + offset;
+        }
+    }
+
+    // Allocations that don't fit in a regular block get a block of their own.
+    int capacity = size + alignment > blockSize ? size + alignment : blockSize;
+    auto block = takeSpareBlock(capacity);
+    if (!block) {
+        block = (Block*)new char[sizeof(Block) + capacity];
+        block->capacity = capacity;
+    }
+    countArenaBlock(sizeof(Block) + block->capacity);
+    block->previous = current;
+    block->used = 0;
+    current = block;
+
+    int offset = (int)(-(intptr_t)(block + 1) & (alignment - 1));
+    block->used = offset + size;
+    return (char*)(block + 1) + offset;
+}
+
+// Regular blocks are taken from the head of the spare list. Larger requests get the smallest
+// large spare that fits. If none is large enough, large spares are freed: they were made for
+// smaller one-off allocations, and keeping them would pile up blocks as allocations grow.
+Arena::Block* Arena::takeSpareBlock(int capacity) {
+    if (capacity <= blockSize) {
+        auto block = spare;
+        if (block) {
+            spare = block->previous;
+            --spareCount;
+        }
+        return block;
+    }
+
+    Block** best = nullptr;
+    for (auto link = &spareLarge; *link; link = &(*link)->previous) {
+        if ((*link)->capacity >= capacity && (!best || (*link)->capacity < (*best)->capacity)) {
+            best = link;
+        }
+    }
+    if (best) {
+        auto block = *best;
+        *best = block->previous;
+        --spareLargeCount;
+        return block;
+    }
+    while (spareLarge) {
+        auto block = spareLarge;
+        spareLarge = block->previous;
+        delete[] (char*)block;
+    }
+    spareLargeCount = 0;
+    return nullptr;
+}
+
+void Arena::releaseBlock(Block* block) {
+    if (block->capacity <= blockSize && spareCount < maxSpareBlocks) {
+        block->previous = spare;
+        spare = block;
+        ++spareCount;
+    } else if (block->capacity > blockSize && spareLargeCount < maxSpareLargeBlocks) {
+        block->previous = spareLarge;
+        spareLarge = block;
+        ++spareLargeCount;
+    } else {
+        delete[] (char*)block;
+    }
+}
+
+StringView Arena::allocateString(int count) {
+    return { (char*)allocate(count, 1), count };
+}
+
+void Arena::reset(const Mark& mark) {
+    while (current != mark.block) {
+        verify(current); // Mark of another arena, or of memory that was already released.
+        auto previous = current->previous;
+        releaseBlock(current);
+        current = previous;
+    }
+    if (current) {
+        verify(mark.used <= current->used);
+        current->used = mark.used;
+    }
+}
+
+static void freeBlocks(Arena::Block* block) {
+    while (block) {
+        auto previous = block->previous;
+        delete[] (char*)block;
+        block = previous;
+    }
+}
+
+void Arena::destroy() {
+    freeBlocks(current);
+    freeBlocks(spare);
+    freeBlocks(spareLarge);
+    current = nullptr;
+    spare = nullptr;
+    spareLarge = nullptr;
+    spareCount = 0;
+    spareLargeCount = 0;
+}
+
+Arena* getScratchArena() {
+    // Never destroyed, the blocks are reused for the lifetime of the thread.
+    static thread_local Arena scratchArena;
+    return &scratchArena;
+}
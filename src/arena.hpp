@@ -0,0 +1,66 @@
+#pragma once
+#include "common.hpp"
+#include <new>
+
+// Bump allocator for data that lives as long as its owner. Memory is released all at once
+// by destroy(), or back to a mark by reset().
+struct Arena {
+    struct Block {
+        Block* previous;
+        int capacity;
+        int used;
+    };
+
+    // Position that reset() returns the arena to.
+    struct Mark {
+        Block* block;
+        int used;
+    };
+
+    // Spare blocks kept by reset() beyond this many are freed, so one large document doesn't
+    // keep its memory for the life of the thread.
+    static const int maxSpareBlocks = 64;
+    static const int maxSpareLargeBlocks = 8;
+
+    Block* current = nullptr;
+    // Blocks released by reset(), reused before new blocks are allocated. Blocks of blockSize
+    // are taken from the head of `spare`; larger ones, made for single allocations, are kept
+    // apart in `spareLarge` so they are the only ones searched for a fit.
+    Block* spare = nullptr;
+    Block* spareLarge = nullptr;
+    int spareCount = 0;
+    int spareLargeCount = 0;
+    int blockSize = 16 * 1024;
+
+    void* allocate(int size, int alignment = sizeof(void*));
+    StringView allocateString(int count);
+    template<typename T> T* create() { return new (allocate(sizeof(T), alignof(T))) T(); }
+    Mark mark() const { return { current, current ? current->used : 0 }; }
+    // Releases everything allocated after mark was taken. Blocks are kept for reuse.
+    void reset(const Mark& mark);
+    void destroy();
+
+private:
+    Block* takeSpareBlock(int capacity);
+    void releaseBlock(Block* block);
+};
+
+// Arena of the calling thread for temporaries, like file contents that are only read while
+// drawing or a page tree that is dropped once its images are collected. Memory is released
+// by leaving the ScratchScope that allocated it; after a few uses scopes allocate nothing
+// from the heap.
+//
+// Functions that produce temporary results take an Arena* and callers pass scratch.arena.
+// A function that opens its own ScratchScope must not allocate its results in the scratch
+// arena, since leaving the scope releases them.
+Arena* getScratchArena();
+
+struct ScratchScope {
+    Arena* arena;
+    Arena::Mark mark;
+
+    ScratchScope() : arena(getScratchArena()), mark(arena->mark()) {}
+    ~ScratchScope() { arena->reset(mark); }
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator=(const ScratchScope&) = delete;
+};
@@ -1,12 +1,29 @@
 #pragma once
 #include "common.hpp"
+#include "arena.hpp"
+#include "memory.hpp"
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+#include <type_traits>
 
+// Growable array. Storage is uninitialized beyond count, so capacity costs no construction.
+// Trivially copyable elements are relocated with realloc or memcpy; other types are move
+// constructed into the new storage and destroyed in the old one. Copying an Array copies the
+// handle, not the elements; destroy() releases them.
+//
+// Storage can be borrowed, like the inline buffer of a SmallArray or arena memory. Borrowed
+// storage is never freed or reallocated; growing past it moves the elements to the heap.
 template<typename T>
 struct Array {
+    static const bool triviallyRelocatable = std::is_trivially_copyable<T>::value;
+    static_assert(alignof(T) <= alignof(max_align_t), "malloc alignment is not enough for T");
+
     T* data = nullptr;
     int count = 0;
     int capacity = 0;
+    bool borrowedStorage = false;
 
     T& operator[](size_t index) {
         verify((int)index < count);
@@ -21,6 +38,7 @@ struct Array {
     void pop() {
         verify(count > 0);
         --count;
+        data[count].~T();
     }
 
     T& last() {
@@ -33,15 +51,26 @@ struct Array {
     const T* begin() const { return data ? &data[0] : nullptr; }
     const T* end() const { return data ? &data[count] : nullptr; }
 
+    // Sets capacity to exactly newCapacity if it is larger, so arrays of known size are
+    // allocated once.
     void reserve(int newCapacity) {
         if (capacity >= newCapacity) {
             return;
         }
-        T* newData = new T[newCapacity];
-        memcpy(newData, this->data, sizeof(T) * this->count);
-        delete[] this->data;
-        this->data = newData;
-        this->capacity = newCapacity;
+        relocate(newCapacity);
+    }
+
+    // Moves the elements to arena memory of exactly newCapacity elements, for arrays that are
+    // as long-lived as the arena and stop growing, like children of a finished XML element.
+    void reserve(int newCapacity, Arena* arena) {
+        if (capacity >= newCapacity) {
+            return;
+        }
+        auto newData = (T*)arena->allocate(sizeof(T) * newCapacity, alignof(T));
+        moveElements(newData);
+        data = newData;
+        capacity = newCapacity;
+        borrowedStorage = true;
     }
 
     void grow(int increment) {
@@ -51,69 +80,104 @@ struct Array {
             if (newCapacity < neededCount) {
                 newCapacity = neededCount;
             }
-            T* newData = new T[newCapacity];
-            memcpy(newData, this->data, sizeof(T) * this->count);
-            delete[] this->data;
-            this->data = newData;
-            this->capacity = newCapacity;
+            relocate(newCapacity);
         }
     }
 
     void push(const T& value) {
-        grow(1);
-        this->data[this->count++] = value;
+        if (count == capacity) {
+            // value may be an element of this array, it is copied before the storage moves.
+            T copy(value);
+            grow(1);
+            new (&data[count]) T(static_cast<T&&>(copy));
+        } else {
+            new (&data[count]) T(value);
+        }
+        ++count;
     }
 
     void pushMultiple(const T* values, size_t numValues) {
         if (numValues) {
             verify(values);
             grow((int)numValues);
-            memcpy(&data[count], values, numValues * sizeof(T));
+            copyConstruct(&data[count], values, numValues);
             count += (int)numValues;
         }
     }
 
     void destroy() {
-        delete[] this->data;
+        destroyElements(0, count);
+        if (!borrowedStorage) {
+            memoryFree(this->data);
+        }
         this->data = nullptr;
         this->count = 0;
         this->capacity = 0;
+        this->borrowedStorage = false;
     }
 
     void removeAt(int index) {
         verify(index >= 0 && index < this->count);
-        memmove(&this->data[index], &this->data[index + 1], sizeof(T) * (size_t)(this->count - index));
-        --this->count;
+        removeManyAt(index, 1);
     }
 
     void removeManyAt(int index, size_t numValues) {
         verify(index >= 0 && index <= this->count);
         verify((size_t)index + numValues <= (size_t)this->count);
         if (numValues) {
-            int right = this->count - index;
-            memmove(&this->data[index], &this->data[index + numValues], sizeof(T) * right);
+            int right = this->count - index - (int)numValues;
+            if (triviallyRelocatable) {
+                memmove(&this->data[index], &this->data[index + numValues], sizeof(T) * right);
+            } else {
+                for (int i = index; i < index + right; ++i) {
+                    data[i] = static_cast<T&&>(data[i + numValues]);
+                }
+                destroyElements(count - (int)numValues, count);
+            }
             this->count -= (int)numValues;
         }
     }
 
     void insertAt(int index, const T& value) {
         verify(index >= 0 && index <= this->count);
-        grow(1);
-        for (int i = count; i > index; --i) {
-            data[i] = data[i - 1];
-        }
-        this->data[index] = value;
-        ++this->count;
+        insertMultipleAt(index, &value, 1);
     }
 
     void insertMultipleAt(int index, const T* values, size_t numValues) {
         verify(index >= 0 && index <= this->count);
         if (numValues) {
+            // values may point into this array, they are copied before the storage moves.
+            Array<T> copies;
+            if (values >= data && values < data + count) {
+                copies.pushMultiple(values, numValues);
+                values = copies.data;
+            }
             grow((int)numValues);
             int right = (this->count - index);
-            memmove(&this->data[index + numValues], &this->data[index], sizeof(T) * right);
-            memcpy(&this->data[index], values, sizeof(T) * numValues);
+            if (triviallyRelocatable) {
+                memmove(&this->data[index + numValues], &this->data[index], sizeof(T) * right);
+                memcpy(&this->data[index], values, sizeof(T) * numValues);
+            } else {
+                // Elements are moved back to front into the gap, constructing the ones that
+                // land past the old end.
+                for (int i = count - 1; i >= index; --i) {
+                    T* target = &data[i + numValues];
+                    if (i + (int)numValues >= count) {
+                        new (target) T(static_cast<T&&>(data[i]));
+                    } else {
+                        *target = static_cast<T&&>(data[i]);
+                    }
+                }
+                for (size_t i = 0; i < numValues; ++i) {
+                    if (index + (int)i < count) {
+                        data[index + i] = values[i];
+                    } else {
+                        new (&data[index + i]) T(values[i]);
+                    }
+                }
+            }
             this->count += (int)numValues;
+            copies.destroy();
         }
     }
 
@@ -147,9 +211,86 @@ struct Array {
 
     void reverse() {
         for (int i = 0; i < count / 2; ++i) {
-            T tmp = data[i];
-            data[i] = data[count - i - 1];
-            data[count - i - 1] = tmp;
+            T tmp = static_cast<T&&>(data[i]);
+            data[i] = static_cast<T&&>(data[count - i - 1]);
+            data[count - i - 1] = static_cast<T&&>(tmp);
+        }
+    }
+
+private:
+    void relocate(int newCapacity) {
+        verify(newCapacity >= count);
+        T* newData;
+        if (triviallyRelocatable && count > 0 && !borrowedStorage) {
+            newData = (T*)memoryReallocate(data, sizeof(T) * newCapacity);
+            verify(newData);
+        } else {
+            // Without elements to keep, realloc would copy stale bytes.
+            newData = (T*)memoryAllocate(sizeof(T) * newCapacity);
+            verify(newData);
+            moveElements(newData);
         }
+        data = newData;
+        capacity = newCapacity;
+        borrowedStorage = false;
+    }
+
+    // Moves the elements to newData and releases the old storage.
+    void moveElements(T* newData) {
+        if (triviallyRelocatable) {
+            if (count > 0) {
+                memcpy(newData, data, sizeof(T) * count);
+            }
+        } else {
+            for (int i = 0; i < count; ++i) {
+                new (&newData[i]) T(static_cast<T&&>(data[i]));
+                data[i].~T();
+            }
+        }
+        if (!borrowedStorage) {
+            memoryFree(data);
+        }
+    }
+
+    static void copyConstruct(T* target, const T* values, size_t numValues) {
+        if (triviallyRelocatable) {
+            memcpy(target, values, sizeof(T) * numValues);
+        } else {
+            for (size_t i = 0; i < numValues; ++i) {
+                new (&target[i]) T(values[i]);
+            }
+        }
+    }
+
+    void destroyElements(int from, int to) {
+        if (!std::is_trivially_destructible<T>::value) {
+            for (int i = from; i < to; ++i) {
+                data[i].~T();
+            }
+        }
+    }
+};
+
+// Array with room for N elements inside the object, for arrays that are usually small. It is
+// used wherever an Array is expected and only allocates when it grows past N elements. The
+// inline buffer moves with the object, so SmallArrays can't be copied.
+template<typename T, int N>
+struct SmallArray : Array<T> {
+    SmallArray() { useInlineStorage(); }
+    SmallArray(const SmallArray&) = delete;
+    SmallArray& operator=(const SmallArray&) = delete;
+
+    void destroy() {
+        Array<T>::destroy();
+        useInlineStorage();
+    }
+
+private:
+    alignas(T) char inlineStorage[sizeof(T) * N];
+
+    void useInlineStorage() {
+        this->data = (T*)inlineStorage;
+        this->capacity = N;
+        this->borrowedStorage = true;
     }
 };
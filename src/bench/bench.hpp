@@ -0,0 +1,60 @@
+#pragma once
+#include "../common.hpp"
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+
+inline double benchSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs body once to warm up, then `iterations` more times, and returns the fastest run in seconds.
+template<typename F>
+double benchMeasure(int iterations, F body) {
+    body();
+    double best = 0;
+    for (int i = 0; i < iterations; ++i) {
+        double start = benchSeconds();
+        body();
+        double elapsed = benchSeconds() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+inline void benchReport(const char* name, double seconds, double bytes) {
+    printf("%-48s %10.3f ms %10.1f MB/s\n", name, seconds * 1000.0, bytes / seconds / (1024.0 * 1024.0));
+}
+
+// Runs body once to warm up, then samples[0, iterations) times, and stores each run's seconds
+// in samples, sorted from fastest to slowest.
+template<typename F>
+void benchSample(int iterations, double* samples, F body) {
+    body();
+    for (int i = 0; i < iterations; ++i) {
+        double start = benchSeconds();
+        body();
+        samples[i] = benchSeconds() - start;
+    }
+    std::sort(samples, samples + iterations);
+}
+
+// Reports the median, 90th and 99th percentile and slowest of sorted samples, which vary
+// more than the fastest run for work that touches files and the heap.
+inline void benchReportPercentiles(const char* name, const double* samples, int count) {
+    auto percentile = [&](int p) { return samples[(count - 1) * p / 100] * 1000.0; };
+    printf("%-48s p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n", name, percentile(50), percentile(90), percentile(99), samples[count - 1] * 1000.0);
+}
+
+// For benchmarks of operations rather than data, like recording a span.
+inline void benchReportPerItem(const char* name, double seconds, double items) {
+    printf("%-48s %10.3f ms %10.1f ns/item\n", name, seconds * 1000.0, seconds * 1e9 / items);
+}
+
+// Keeps the compiler from optimizing away results of benchmarked code. Unsigned, so sums that
+// wrap around are well defined.
+extern volatile uint64_t benchSink;
@@ -0,0 +1,92 @@
+#include "bench.hpp"
+#include "../arena.hpp"
+#include "../array.hpp"
+#include "../string.hpp"
+#include "../utf.hpp"
+#include "../xml.hpp"
+
+// How titles were converted before the scratch arena: a new[] buffer per call.
+static uint16_t* newUtf16(const StringView& src) {
+    auto dst = new uint16_t[utf8ToUtf16MaxSize(src.count) + 1];
+    int count = utf8ToUtf16(src.chars, src.count, dst);
+    dst[count] = 0;
+    return dst;
+}
+
+// What toUtf16 does, which only exists on Windows.
+static uint16_t* arenaUtf16(const StringView& src, Arena* arena) {
+    auto dst = (uint16_t*)arena->allocate((utf8ToUtf16MaxSize(src.count) + 1) * sizeof(uint16_t), alignof(uint16_t));
+    int count = utf8ToUtf16(src.chars, src.count, dst);
+    dst[count] = 0;
+    return dst;
+}
+
+// Page with paragraphs of text and images, like the pages that are scanned for images.
+static OwnedString makePage(int paragraphCount) {
+    StringBuilder page;
+    page.append("<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Page</title></head><body>\n");
+    for (int i = 0; i < paragraphCount; ++i) {
+        page.append("<p class=\"text\">Paragraph <em>").append(i).append("</em> of the page.</p>\n");
+        page.append("<div><img src=\"../Images/").append(i).append(".jpg\" alt=\"\"/></div>\n");
+    }
+    page.append("</body></html>\n");
+    return page.toOwnedString();
+}
+
+void benchScratchArena() {
+    const int iterations = 20;
+    auto title = StringView("Book Image Viewer - (12/345) - Some Book With A Long Title.epub");
+    const int titleCount = 100 * 1000;
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < titleCount; ++i) {
+            auto wide = newUtf16(title);
+            benchSink += wide[i % title.count];
+            delete[] wide;
+        }
+    });
+    benchReport("100K titles to UTF-16, new[]", seconds, (double)titleCount * title.count);
+
+    auto scratchTitles = [&] {
+        for (int i = 0; i < titleCount; ++i) {
+            ScratchScope scratch;
+            auto wide = arenaUtf16(title, scratch.arena);
+            benchSink += wide[i % title.count];
+        }
+    };
+    seconds = benchMeasure(iterations, scratchTitles);
+    benchReport("100K titles to UTF-16, scratch arena", seconds, (double)titleCount * title.count);
+
+    // Pages are parsed the way EPub::parse reads them, into a buffer of their own.
+    auto page = makePage(2000);
+    const int pageCount = 20;
+    XmlParseOptions options;
+    options.dropWhiteSpaceText = true;
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pageCount; ++i) {
+            XmlDocumentScope document(options);
+            auto source = document.options.arena->allocateString(page.count());
+            memcpy(source.chars, page.chars(), page.count());
+            auto root = document.release(parseXml(source, document.options));
+            benchSink += root->children.count;
+            root->document->destroy();
+        }
+    });
+    benchReport("20 pages, document arenas", seconds, (double)pageCount * page.count());
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pageCount; ++i) {
+            ScratchScope scratch;
+            auto source = scratch.arena->allocateString(page.count());
+            memcpy(source.chars, page.chars(), page.count());
+            options.arena = scratch.arena;
+            benchSink += parseXml(source, options)->children.count;
+        }
+    });
+    benchReport("20 pages, scratch arena", seconds, (double)pageCount * page.count());
+
+    // Pages leave many spare blocks behind, taking one must not get slower with their number.
+    seconds = benchMeasure(iterations, scratchTitles);
+    benchReport("100K titles to UTF-16, scratch arena after pages", seconds, (double)titleCount * title.count);
+}
@@ -0,0 +1,137 @@
+#include "bench.hpp"
+#include "../array.hpp"
+
+// How Array grew before: default-constructed new T[] and memcpy of the old elements.
+template<typename T>
+struct NewArray {
+    T* data = nullptr;
+    int count = 0;
+    int capacity = 0;
+
+    void push(const T& value) {
+        if (count == capacity) {
+            int newCapacity = capacity < 4 ? 4 : capacity * 2;
+            T* newData = new T[newCapacity];
+            if (count) {
+                memcpy(newData, data, sizeof(T) * count);
+            }
+            delete[] data;
+            data = newData;
+            capacity = newCapacity;
+        }
+        data[count++] = value;
+    }
+
+    void destroy() {
+        delete[] data;
+    }
+};
+
+// Element with a constructor, like XmlToken, so new T[] has to initialize every slot.
+struct Token {
+    int type = 0;
+    StringView text;
+    bool flag = false;
+};
+
+template<typename T>
+static void benchPushes(const char* name, int count) {
+    const int iterations = 20;
+    double bytes = (double)count * sizeof(T);
+    char label[128];
+
+    double seconds = benchMeasure(iterations, [&] {
+        NewArray<T> array;
+        for (int i = 0; i < count; ++i) {
+            array.push(T());
+        }
+        benchSink += array.count;
+        array.destroy();
+    });
+    snprintf(label, sizeof(label), "%s, new[] and memcpy", name);
+    benchReport(label, seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        Array<T> array;
+        for (int i = 0; i < count; ++i) {
+            array.push(T());
+        }
+        benchSink += array.count;
+        array.destroy();
+    });
+    snprintf(label, sizeof(label), "%s, realloc", name);
+    benchReport(label, seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        Array<T> array;
+        array.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            array.push(T());
+        }
+        benchSink += array.count;
+        array.destroy();
+    });
+    snprintf(label, sizeof(label), "%s, reserved", name);
+    benchReport(label, seconds, bytes);
+}
+
+void benchArrayGrowth() {
+    benchPushes<int>("1M ints", 1000 * 1000);
+    benchPushes<Token>("1M tokens", 1000 * 1000);
+}
+
+// Child lists of a parsed page: most are short, a few are long. Each list is filled and then
+// kept, like XmlElement::children.
+template<typename Children>
+static int fillChildLists(Children* lists, int listCount, Arena* arena) {
+    int total = 0;
+    for (int i = 0; i < listCount; ++i) {
+        int childCount = i % 16 == 0 ? 40 : i % 4;
+        auto& list = lists[i];
+        if (arena) {
+            list.reserve(childCount, arena);
+        } else {
+            list.reserve(childCount);
+        }
+        for (int j = 0; j < childCount; ++j) {
+            list.push(&lists[j]);
+        }
+        total += list.count;
+    }
+    return total;
+}
+
+void benchSmallArrays() {
+    const int iterations = 20;
+    const int listCount = 100 * 1000;
+    double bytes = (double)listCount * sizeof(void*);
+
+    double seconds = benchMeasure(iterations, [&] {
+        auto lists = new Array<void*>[listCount];
+        benchSink += fillChildLists(lists, listCount, nullptr);
+        for (int i = 0; i < listCount; ++i) {
+            lists[i].destroy();
+        }
+        delete[] lists;
+    });
+    benchReport("100K child lists, Array", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        auto lists = new SmallArray<void*, 4>[listCount];
+        benchSink += fillChildLists(lists, listCount, nullptr);
+        for (int i = 0; i < listCount; ++i) {
+            lists[i].destroy();
+        }
+        delete[] lists;
+    });
+    benchReport("100K child lists, SmallArray", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        Arena arena;
+        auto lists = new SmallArray<void*, 4>[listCount];
+        benchSink += fillChildLists(lists, listCount, &arena);
+        delete[] lists;
+        arena.destroy();
+    });
+    benchReport("100K child lists, SmallArray spilling to arena", seconds, bytes);
+}
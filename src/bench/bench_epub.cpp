@@ -0,0 +1,114 @@
+#include "bench.hpp"
+#include "epub_generator.hpp"
+#include "../arena.hpp"
+#include "../array.hpp"
+#include "../epub.hpp"
+#include "../string.hpp"
+#include "../xml.hpp"
+#include <stdio.h>
+
+struct CorpusBook {
+    const char* name;
+    EPubShape shape;
+};
+
+static void benchBook(const CorpusBook& book) {
+    const int iterations = 50;
+    double samples[iterations];
+    StringBuilder label;
+
+    char path[64];
+    snprintf(path, sizeof(path), "bench-%s.epub", book.name);
+    generateEPub(path, book.shape);
+
+    benchSample(iterations, samples, [&] {
+        EPub epub;
+        epub.parse(wrapCString(path));
+        benchSink += epub.images.count;
+        epub.destroy();
+    });
+    label.clear();
+    label.appendFormat("%s, EPub::parse", book.name);
+    benchReportPercentiles(label.chars, samples, iterations);
+
+    // The other steps are timed on an open book, without opening the archive every time.
+    EPub epub;
+    epub.parse(wrapCString(path));
+
+    benchSample(iterations, samples, [&] {
+        for (const auto& image : epub.images) {
+            ScratchScope scratch;
+            benchSink += epub.readFile(image, scratch.arena).count;
+        }
+    });
+    label.clear();
+    label.appendFormat("%s, readFile of %d images", book.name, epub.images.count);
+    benchReportPercentiles(label.chars, samples, iterations);
+
+    // Pages are inflated up front, so only parsing is timed.
+    Arena arena;
+    Array<StringView> pages;
+    for (const auto& item : epub.linearItemOrder) {
+        pages.push(epub.readFile(item->href, &arena));
+    }
+    static const StringView pageSkipElements[]{ "head", "style", "script" };
+    XmlParseOptions pageOptions;
+    pageOptions.skipElements = pageSkipElements;
+    pageOptions.skipElementCount = _countof(pageSkipElements);
+    pageOptions.dropWhiteSpaceText = true;
+
+    benchSample(iterations, samples, [&] {
+        for (const auto& page : pages) {
+            ScratchScope scratch;
+            pageOptions.arena = scratch.arena;
+            benchSink += parseXml(page, pageOptions)->children.count;
+        }
+    });
+    label.clear();
+    label.appendFormat("%s, parseXml of %d pages", book.name, pages.count);
+    benchReportPercentiles(label.chars, samples, iterations);
+
+    // Image paths as they appear in the pages, relative to the page's folder. Images are
+    // under "OEBPS/".
+    Array<StringView> hrefs;
+    for (const auto& image : epub.images) {
+        StringBuilder href;
+        href.append("../").append(substring(image, 6, image.count - 6));
+        hrefs.push(href.toString(&arena));
+    }
+    benchSample(iterations, samples, [&] {
+        char buffer[256];
+        for (const auto& href : hrefs) {
+            benchSink += resolveRelativePath("OEBPS/Text", href, buffer);
+        }
+    });
+    label.clear();
+    label.appendFormat("%s, resolveRelativePath of %d paths", book.name, hrefs.count);
+    benchReportPercentiles(label.chars, samples, iterations);
+
+    pages.destroy();
+    hrefs.destroy();
+    arena.destroy();
+    epub.destroy();
+    remove(path);
+}
+
+void benchEPubCorpus() {
+    CorpusBook books[3];
+    books[0].name = "small";
+    books[0].shape.spineLength = 10;
+    books[0].shape.pageSize = 4 * 1024;
+    books[0].shape.storedPercent = 100;
+
+    books[1].name = "default";
+
+    books[2].name = "large";
+    books[2].shape.spineLength = 200;
+    books[2].shape.imagesPerPage = 2;
+    books[2].shape.pageSize = 32 * 1024;
+    books[2].shape.nestingDepth = 6;
+
+    for (const auto& book : books) {
+        benchBook(book);
+    }
+}
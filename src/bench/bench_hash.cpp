@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "../hash.hpp"
+#include "../array.hpp"
+
+// Zip entry names like those of an illustrated book, in mixed case.
+static Array<StringView> makeEntryNames(int count, Arena* arena) {
+    Array<StringView> names;
+    char name[64];
+    for (int i = 0; i < count; ++i) {
+        int length = snprintf(name, sizeof(name), i % 2 ? "OEBPS/Images/Page-%04d.JPG" : "OEBPS/Text/page-%04d.xhtml", i);
+        names.push(copyString({ name, length }, arena));
+    }
+    return names;
+}
+
+static void benchLookups(int count) {
+    const int iterations = 20;
+    Arena arena;
+    auto names = makeEntryNames(count, &arena);
+    // Look up every name in the order pages are read, as opening a book does.
+    double bytes = 0;
+    for (const auto& name : names) {
+        bytes += name.count;
+    }
+    char label[128];
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (const auto& name : names) {
+            for (int i = 0; i < names.count; ++i) {
+                if (stringEqualsCaseInsensitive(names[i], name)) {
+                    benchSink += i;
+                    break;
+                }
+            }
+        }
+    });
+    snprintf(label, sizeof(label), "%d names, linear scan", count);
+    benchReport(label, seconds, bytes);
+
+    HashMap<StringView, int, CaseInsensitiveStringHashTraits> indices;
+    for (int i = 0; i < names.count; ++i) {
+        indices.insert(names[i], i);
+    }
+    seconds = benchMeasure(iterations, [&] {
+        for (const auto& name : names) {
+            benchSink += *indices.find(name);
+        }
+    });
+    snprintf(label, sizeof(label), "%d names, HashMap", count);
+    benchReport(label, seconds, bytes);
+
+    // Deduplicating image URLs: every name is added twice.
+    seconds = benchMeasure(iterations, [&] {
+        HashSet<StringView, CaseInsensitiveStringHashTraits> set;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const auto& name : names) {
+                benchSink += set.add(name);
+            }
+        }
+        set.destroy();
+    });
+    snprintf(label, sizeof(label), "%d names, HashSet dedupe", count);
+    benchReport(label, seconds, bytes * 2);
+
+    indices.destroy();
+    names.destroy();
+    arena.destroy();
+}
+
+void benchHashLookups() {
+    for (int count = 16; count <= 4096; count *= 4) {
+        benchLookups(count);
+    }
+}
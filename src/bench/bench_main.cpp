@@ -0,0 +1,74 @@
+#include "bench.hpp"
+#include "epub_generator.hpp"
+#include <string.h>
+
+volatile uint64_t benchSink = 0;
+
+void benchXmlCharClasses();
+void benchXmlEncodings();
+void benchUtfTranscoding();
+void benchHashLookups();
+void benchStringCompare();
+void benchPathResolution();
+void benchStringBuilder();
+void benchArrayGrowth();
+void benchSmallArrays();
+void benchScratchArena();
+void benchMemoryAccounting();
+void benchTracing();
+void benchEPubCorpus();
+
+struct Benchmark {
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark benchmarks[]{
+    { "xml-char-classes", benchXmlCharClasses },
+    { "xml-encodings", benchXmlEncodings },
+    { "utf-transcoding", benchUtfTranscoding },
+    { "hash-lookups", benchHashLookups },
+    { "string-compare", benchStringCompare },
+    { "path-resolution", benchPathResolution },
+    { "string-builder", benchStringBuilder },
+    { "array-growth", benchArrayGrowth },
+    { "small-arrays", benchSmallArrays },
+    { "scratch-arena", benchScratchArena },
+    { "memory-accounting", benchMemoryAccounting },
+    { "tracing", benchTracing },
+    { "epub-corpus", benchEPubCorpus },
+};
+
+// Usage: BookViewBench generate-epub <file> [key=value...], see parseEPubShapeOption.
+static int runGenerator(int argc, char** argv) {
+    EPubShape shape;
+    for (int i = 3; i < argc; ++i) {
+        if (!parseEPubShapeOption(argv[i], &shape)) {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    generateEPub(argv[2], shape);
+    return 0;
+}
+
+// Usage: BookViewBench [benchmark names...]. Runs all benchmarks by default.
+int main(int argc, char** argv) {
+    if (argc >= 3 && strcmp(argv[1], "generate-epub") == 0) {
+        return runGenerator(argc, argv);
+    }
+    for (const auto& benchmark : benchmarks) {
+        bool selected = argc <= 1;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], benchmark.name) == 0) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            printf("%s\n", benchmark.name);
+            benchmark.run();
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include "bench.hpp"
+#include "../memory.hpp"
+#include <stdlib.h>
+
+// Cost of counting: the same allocation pattern with plain malloc and with the counted calls
+// that new, Array and miniz go through.
+void benchMemoryAccounting() {
+    const int iterations = 20;
+    const int count = 1000 * 1000;
+    static void* blocks[64];
+    double bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        bytes += 16 + (i & 255);
+    }
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < count; ++i) {
+            int slot = i & 63;
+            free(blocks[slot]);
+            blocks[slot] = malloc(16 + (i & 255));
+        }
+    });
+    benchReport("1M malloc and free", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < count; ++i) {
+            int slot = i & 63;
+            memoryFree(blocks[slot]);
+            blocks[slot] = memoryAllocate(16 + (i & 255));
+        }
+    });
+    benchReport("1M counted allocations and frees", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        MemoryPhaseScope phase(MemoryPhase::ParseXml);
+        for (int i = 0; i < count; ++i) {
+            int slot = i & 63;
+            memoryFree(blocks[slot]);
+            blocks[slot] = memoryAllocate(16 + (i & 255));
+        }
+    });
+    benchReport("1M counted allocations and frees, in a phase", seconds, bytes);
+
+    for (auto& block : blocks) {
+        memoryFree(block);
+        block = nullptr;
+    }
+    benchSink += getMemoryStats().phases[(int)MemoryPhase::ParseXml].allocations;
+}
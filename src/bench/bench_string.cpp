@@ -0,0 +1,207 @@
+#include "bench.hpp"
+#include "../string.hpp"
+#include "../array.hpp"
+#include <string.h>
+#include <stdarg.h>
+
+// What stringEqualsCaseInsensitive does for ASCII, one byte at a time.
+static bool equalsBytewise(const char* a, const char* b, int count) {
+    for (int i = 0; i < count; ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] + 0x20 : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] + 0x20 : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Called through a pointer, so like stringEqualsCaseInsensitive it is not inlined and hoisted out of loops.
+static bool (*volatile bytewise)(const char* a, const char* b, int count) = equalsBytewise;
+
+static void benchCompare(int length) {
+    const int iterations = 20;
+    const int pairCount = 1024 * 1024 / length;
+    // Equal strings in opposite case, so every byte is compared.
+    static const char sample[] = "OEBPS/Images/Illustration-0001.jpeg ";
+    auto a = new char[length];
+    auto b = new char[length];
+    for (int i = 0; i < length; ++i) {
+        char c = sample[i % (sizeof(sample) - 1)];
+        a[i] = c;
+        b[i] = c >= 'a' && c <= 'z' ? c - 0x20 : c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+    }
+    double bytes = (double)pairCount * length;
+    char label[128];
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pairCount; ++i) {
+            benchSink += bytewise(a, b, length);
+        }
+    });
+    snprintf(label, sizeof(label), "%d bytes, byte at a time", length);
+    benchReport(label, seconds, bytes);
+
+#ifdef _WIN32
+    // What stringEqualsCaseInsensitive did before.
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pairCount; ++i) {
+            benchSink += _strnicmp(a, b, length) == 0;
+        }
+    });
+    snprintf(label, sizeof(label), "%d bytes, _strnicmp", length);
+    benchReport(label, seconds, bytes);
+#endif
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pairCount; ++i) {
+            benchSink += stringEqualsCaseInsensitive(a, length, b, length);
+        }
+    });
+    snprintf(label, sizeof(label), "%d bytes, stringEqualsCaseInsensitive", length);
+    benchReport(label, seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pairCount; ++i) {
+            benchSink += hashStringCaseInsensitive({ a, length });
+        }
+    });
+    snprintf(label, sizeof(label), "%d bytes, hashStringCaseInsensitive", length);
+    benchReport(label, seconds, bytes);
+
+    delete[] b;
+    delete[] a;
+}
+
+void benchStringCompare() {
+    for (int length = 4; length <= 256; length *= 4) {
+        benchCompare(length);
+    }
+}
+
+// How resolveRelativePath worked before: split into a heap array, remove ".." with
+// Array::removeAt and join into a new allocation.
+static StringView resolveBySplitting(const StringView& directory, const StringView& target) {
+    Array<StringView> components;
+    const StringView paths[]{ directory, target };
+    for (const auto& path : paths) {
+        int start = 0;
+        for (int i = 0; i <= path.count; ++i) {
+            if (i == path.count || path[i] == '/') {
+                if (i > start) {
+                    components.push(substring(path, start, i - start));
+                }
+                start = i + 1;
+            }
+        }
+    }
+    for (int i = 0; i < components.count; ++i) {
+        if (components[i] == "..") {
+            components.removeAt(i);
+            components.removeAt(i - 1);
+            i -= 2;
+        }
+    }
+    if (components.count == 0) {
+        components.destroy();
+        return {};
+    }
+    int count = components.count - 1;
+    for (const auto& component : components) {
+        count += component.count;
+    }
+    StringView result{ new char[count], count };
+    auto now = result.chars;
+    for (int i = 0; i < components.count; ++i) {
+        memcpy(now, components[i].chars, components[i].count);
+        now += components[i].count;
+        if (i != components.count - 1) *now++ = '/';
+    }
+    components.destroy();
+    return result;
+}
+
+void benchPathResolution() {
+    const int iterations = 20;
+    const int pathCount = 100 * 1000;
+    const StringView directory = "OEBPS/Text/part-0001";
+    const StringView target = "../../Images/illustration-0001.jpeg";
+    double bytes = (double)pathCount * (directory.count + target.count);
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pathCount; ++i) {
+            auto path = resolveBySplitting(directory, target);
+            benchSink += path.count;
+            delete[] path.chars;
+        }
+    });
+    benchReport("split, removeAt and join", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        Arena arena;
+        for (int i = 0; i < pathCount; ++i) {
+            benchSink += resolveRelativePath(directory, target, &arena).count;
+        }
+        arena.destroy();
+    });
+    benchReport("resolveRelativePath, arena", seconds, bytes);
+
+    char buffer[256];
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < pathCount; ++i) {
+            benchSink += resolveRelativePath(directory, target, buffer);
+        }
+    });
+    benchReport("resolveRelativePath, caller buffer", seconds, bytes);
+}
+
+// How mprintf worked: measure, allocate, then format again. It measured with _vscprintf, which
+// is vsnprintf into no buffer.
+static OwnedString formatTwice(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list measureArgs;
+    va_copy(measureArgs, args);
+    int count = vsnprintf(nullptr, 0, format, measureArgs);
+    va_end(measureArgs);
+    auto result = OwnedString::allocate(count);
+    vsnprintf(result.chars(), count + 1, format, args);
+    va_end(args);
+    return result;
+}
+
+void benchStringBuilder() {
+    const int iterations = 20;
+    const int titleCount = 100 * 1000;
+    const StringView fileName = "C:\\Users\\reader\\Books\\Illustrated Book Volume 12.epub";
+    const auto fileNameChars = "C:\\Users\\reader\\Books\\Illustrated Book Volume 12.epub";
+    // Roughly the length of a window title.
+    double bytes = (double)titleCount * (fileName.count + 32);
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < titleCount; ++i) {
+            auto title = formatTwice("Book Image Viewer - (%d/%d) - %s", i, titleCount, fileNameChars);
+            benchSink += title.count();
+        }
+    });
+    benchReport("titles, measure and format again", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < titleCount; ++i) {
+            StringBuilder title;
+            title.appendFormat("Book Image Viewer - (%d/%d) - %s", i, titleCount, fileNameChars);
+            benchSink += title.count;
+        }
+    });
+    benchReport("titles, StringBuilder::appendFormat", seconds, bytes);
+
+    seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < titleCount; ++i) {
+            StringBuilder title;
+            title.append("Book Image Viewer - (").append(i).append('/').append(titleCount);
+            title.append(") - ").append(fileName);
+            benchSink += title.count;
+        }
+    });
+    benchReport("titles, StringBuilder::append", seconds, bytes);
+}
@@ -0,0 +1,39 @@
+#include "bench.hpp"
+#include "../trace.hpp"
+#include "../string.hpp"
+
+// Spans around a tiny piece of work, so the cost of the span itself dominates.
+static void runSpans(int count) {
+    for (int i = 0; i < count; ++i) {
+        TraceSpan span("bench");
+        benchSink += i;
+    }
+}
+
+void benchTracing() {
+    const int iterations = 20;
+    const int count = 1000 * 1000;
+
+    double seconds = benchMeasure(iterations, [&] {
+        for (int i = 0; i < count; ++i) {
+            benchSink += i;
+        }
+    });
+    benchReportPerItem("1M iterations without spans", seconds, count);
+
+    enableTracing(false);
+    seconds = benchMeasure(iterations, [&] { runSpans(count); });
+    benchReportPerItem("1M spans, tracing disabled", seconds, count);
+
+    enableTracing(true);
+    seconds = benchMeasure(iterations, [&] { runSpans(count); });
+    benchReportPerItem("1M spans, tracing enabled", seconds, count);
+
+    StringBuilder trace;
+    seconds = benchMeasure(iterations, [&] {
+        trace.clear();
+        appendChromeTrace(trace);
+    });
+    benchReport("export a full ring as Chrome trace", seconds, trace.count);
+    enableTracing(false);
+}
@@ -0,0 +1,90 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#endif
+#include "bench.hpp"
+#include "../utf.hpp"
+#include "../array.hpp"
+#include "../string.hpp"
+
+// Zip entry names of a Japanese book: ASCII directories and extensions around CJK names.
+static OwnedString makeMixedPaths(int pathCount) {
+    static const char* const paths[]{
+        "OEBPS/Text/\xE7\xAC\xAC\xE4\xB8\x80\xE7\xAB\xA0.xhtml",
+        "OEBPS/Images/\xE8\xA1\xA8\xE7\xB4\x99_cover_0001.jpg",
+        "OEBPS/Text/chapter-0002-\xE3\x81\x82\xE3\x81\xA8\xE3\x81\x8C\xE3\x81\x8D.xhtml",
+        "OEBPS/Styles/stylesheet.css",
+    };
+    Array<char> text;
+    for (int i = 0; i < pathCount; ++i) {
+        auto path = paths[i % _countof(paths)];
+        text.pushMultiple(path, strlen(path));
+        text.push('\n');
+    }
+    OwnedString result({ text.data, text.count });
+    text.destroy();
+    return result;
+}
+
+static OwnedString makeAsciiPaths(int pathCount) {
+    static const char* const path = "OEBPS/Images/illustration-0001-full-page.jpeg\n";
+    Array<char> text;
+    for (int i = 0; i < pathCount; ++i) {
+        text.pushMultiple(path, strlen(path));
+    }
+    OwnedString result({ text.data, text.count });
+    text.destroy();
+    return result;
+}
+
+static void benchTranscoding(const char* name, const StringView& utf8) {
+    const int iterations = 20;
+    auto utf16 = new uint16_t[utf8ToUtf16MaxSize(utf8.count)];
+    int unitCount = utf8ToUtf16(utf8.chars, utf8.count, utf16);
+    auto buffer = new char[utf16ToUtf8MaxSize(unitCount)];
+    char label[128];
+
+    double seconds = benchMeasure(iterations, [&] { benchSink += utf8ToUtf16(utf8.chars, utf8.count, utf16); });
+    snprintf(label, sizeof(label), "%s, UTF-8 to UTF-16", name);
+    benchReport(label, seconds, utf8.count);
+
+    seconds = benchMeasure(iterations, [&] { benchSink += utf16ToUtf8(utf16, unitCount, buffer); });
+    snprintf(label, sizeof(label), "%s, UTF-16 to UTF-8, max size", name);
+    benchReport(label, seconds, utf8.count);
+
+    seconds = benchMeasure(iterations, [&] {
+        int size = utf16ToUtf8Size(utf16, unitCount);
+        benchSink += utf16ToUtf8(utf16, unitCount, buffer) - size;
+    });
+    snprintf(label, sizeof(label), "%s, UTF-16 to UTF-8, exact size", name);
+    benchReport(label, seconds, utf8.count);
+
+#ifdef _WIN32
+    // What toUtf8 and toUtf16 did before.
+    seconds = benchMeasure(iterations, [&] {
+        int count = MultiByteToWideChar(CP_UTF8, 0, utf8.chars, utf8.count, nullptr, 0);
+        benchSink += MultiByteToWideChar(CP_UTF8, 0, utf8.chars, utf8.count, (wchar_t*)utf16, count);
+    });
+    snprintf(label, sizeof(label), "%s, MultiByteToWideChar", name);
+    benchReport(label, seconds, utf8.count);
+
+    seconds = benchMeasure(iterations, [&] {
+        int size = WideCharToMultiByte(CP_UTF8, 0, (const wchar_t*)utf16, unitCount, nullptr, 0, nullptr, nullptr);
+        benchSink += WideCharToMultiByte(CP_UTF8, 0, (const wchar_t*)utf16, unitCount, buffer, size, nullptr, nullptr);
+    });
+    snprintf(label, sizeof(label), "%s, WideCharToMultiByte", name);
+    benchReport(label, seconds, utf8.count);
+#endif
+
+    delete[] buffer;
+    delete[] utf16;
+}
+
+void benchUtfTranscoding() {
+    auto mixed = makeMixedPaths(100 * 1000);
+    benchTranscoding("mixed CJK paths", mixed);
+
+    auto ascii = makeAsciiPaths(100 * 1000);
+    benchTranscoding("ASCII paths", ascii);
+}
@@ -0,0 +1,199 @@
+#include "bench.hpp"
+#include "../xml.hpp"
+#include "../arena.hpp"
+#include "../array.hpp"
+#include "../string.hpp"
+#include "../utf.hpp"
+
+// Character classification as the tokenizer did it before xmlCharClasses.
+static inline bool branchyIsNameChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == ':';
+}
+
+static inline bool branchyIsWhiteSpaceOrNewLine(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// The classes of xmlCharClasses computed with comparisons, for scans whose mask is only known
+// at run time.
+static inline uint8_t branchyCharClasses(char c) {
+    uint8_t classes = 0;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == ':') classes |= XmlCharNameStart | XmlCharName;
+    if (c >= '0' && c <= '9') classes |= XmlCharName;
+    if (c == ' ' || c == '\t') classes |= XmlCharWhiteSpace;
+    if (c == '\r' || c == '\n') classes |= XmlCharNewLine;
+    if (c == '"') classes |= XmlCharDoubleQuote;
+    if (c == '\'') classes |= XmlCharSingleQuote;
+    return classes;
+}
+
+// Name-heavy markup like SVG or attribute-rich XHTML.
+static OwnedString makeNameHeavyMarkup(int elementCount) {
+    static const char* const element =
+        "<svg:rect-shape data-index-value=\"12\" xlink:href=\"#id-3\" stroke-line-join=\"round\"\n"
+        "    fill-rule=\"even-odd\" class=\"frame border-0\"/>\n";
+    int elementLength = (int)strlen(element);
+
+    Array<char> markup;
+    markup.pushMultiple("<root>\n", 7);
+    for (int i = 0; i < elementCount; ++i) {
+        markup.pushMultiple(element, elementLength);
+    }
+    markup.pushMultiple("</root>\n", 8);
+    OwnedString result({ markup.data, markup.count });
+    markup.destroy();
+    return result;
+}
+
+// Both scans alternate between runs of a character class and single other characters, so
+// every byte of the input is classified.
+template<typename IsInClass>
+static int countRuns(const StringView& text, IsInClass isInClass) {
+    int runs = 0;
+    const char* now = text.chars;
+    const char* end = text.chars + text.count;
+    while (now < end) {
+        if (isInClass(*now)) {
+            ++runs;
+            do {
+                ++now;
+            } while (now < end && isInClass(*now));
+        } else {
+            ++now;
+        }
+    }
+    return runs;
+}
+
+// Like the tokenizer, each run is scanned with the mask of the state it is in, here taken in
+// turn from the masks of names, white space and attribute values.
+template<typename ClassesOf>
+static int countStateRuns(const StringView& text, ClassesOf classesOf) {
+    static volatile uint8_t stateMasks[]{ XmlCharName, XmlCharWhiteSpace | XmlCharNewLine, XmlCharName | XmlCharWhiteSpace };
+    uint8_t masks[_countof(stateMasks)];
+    for (int i = 0; i < _countof(masks); ++i) {
+        masks[i] = stateMasks[i];
+    }
+    int runs = 0;
+    const char* now = text.chars;
+    const char* end = text.chars + text.count;
+    while (now < end) {
+        uint8_t mask = masks[runs % _countof(masks)];
+        if (classesOf(*now) & mask) {
+            ++runs;
+            do {
+                ++now;
+            } while (now < end && (classesOf(*now) & mask));
+        } else {
+            ++now;
+        }
+    }
+    return runs;
+}
+
+void benchXmlCharClasses() {
+    const int iterations = 20;
+    auto markup = makeNameHeavyMarkup(100 * 1000);
+
+    double seconds = benchMeasure(iterations, [&] { benchSink += countRuns(markup, branchyIsNameChar); });
+    benchReport("names, range comparisons", seconds, markup.count());
+
+    seconds = benchMeasure(iterations, [&] { benchSink += countRuns(markup, [](char c) { return hasXmlCharClass(c, XmlCharName); }); });
+    benchReport("names, xmlCharClasses", seconds, markup.count());
+
+    seconds = benchMeasure(iterations, [&] { benchSink += countRuns(markup, branchyIsWhiteSpaceOrNewLine); });
+    benchReport("white space, comparisons", seconds, markup.count());
+
+    seconds = benchMeasure(iterations, [&] { benchSink += countRuns(markup, [](char c) { return hasXmlCharClass(c, XmlCharWhiteSpace | XmlCharNewLine); }); });
+    benchReport("white space, xmlCharClasses", seconds, markup.count());
+
+    // The tokenizer's masks depend on its state, so comparisons have to find every class of a byte.
+    seconds = benchMeasure(iterations, [&] { benchSink += countStateRuns(markup, branchyCharClasses); });
+    benchReport("state masks, comparisons", seconds, markup.count());
+
+    seconds = benchMeasure(iterations, [&] { benchSink += countStateRuns(markup, [](char c) { return xmlCharClasses.classes[(uint8_t)c]; }); });
+    benchReport("state masks, xmlCharClasses", seconds, markup.count());
+
+    seconds = benchMeasure(iterations, [&] {
+        XmlParser parser;
+        parser.init(markup);
+        XmlToken token;
+        while (parser.next(&token)) {
+            ++benchSink;
+        }
+        parser.destroy();
+    });
+    benchReport("tokenizer", seconds, markup.count());
+}
+
+// XHTML page with Japanese paragraphs as UTF-16LE with a byte order mark.
+static OwnedString makeUtf16Page(int paragraphCount) {
+    static const char* const openParagraph = "<p class=\"text\">";
+    static const char* const closeParagraph = "</p>\n<div><img src=\"../Images/page.jpg\" alt=\"\"/></div>\n";
+    static const uint16_t japanese[]{ 0x3053, 0x308C, 0x306F, 0x65E5, 0x672C, 0x8A9E, 0x306E, 0x6587, 0x7AE0, 0x3067, 0x3059, 0x3002 };
+
+    Array<uint16_t> units;
+    auto pushAscii = [&](const char* text) {
+        for (; *text; ++text) {
+            units.push((uint8_t)*text);
+        }
+    };
+    units.push(0xFEFF);
+    pushAscii("<?xml version=\"1.0\" encoding=\"UTF-16\"?>\n<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>\n");
+    for (int i = 0; i < paragraphCount; ++i) {
+        pushAscii(openParagraph);
+        for (int j = 0; j < 8; ++j) {
+            units.pushMultiple(japanese, _countof(japanese));
+        }
+        pushAscii(closeParagraph);
+    }
+    pushAscii("</body></html>\n");
+
+    // Little-endian bytes regardless of the host.
+    auto result = OwnedString::allocate(units.count * 2);
+    auto bytes = result.chars();
+    for (int i = 0; i < units.count; ++i) {
+        bytes[i * 2] = (char)(units[i] & 0xFF);
+        bytes[i * 2 + 1] = (char)(units[i] >> 8);
+    }
+    units.destroy();
+    return result;
+}
+
+void benchXmlEncodings() {
+    const int iterations = 10;
+    auto utf16 = makeUtf16Page(20 * 1000);
+    int unitCount = utf16.count() / 2 - 1;
+    StringView utf8{ new char[utf16ToUtf8MaxSize(unitCount)], 0 };
+    utf8.count = utf16BytesToUtf8(utf16.chars() + 2, unitCount, false, utf8.chars);
+
+    XmlParseOptions options;
+    options.parallelMinSize = 0;
+
+    double seconds = benchMeasure(iterations, [&] { benchSink += utf16BytesToUtf8(utf16.chars() + 2, unitCount, false, utf8.chars); });
+    benchReport("transcode UTF-16 to UTF-8", seconds, utf16.count());
+
+    seconds = benchMeasure(iterations, [&] {
+        auto root = parseXml(utf8, options);
+        benchSink += root->children.count;
+        root->document->destroy();
+    });
+    benchReport("parseXml, UTF-8 page", seconds, utf8.count);
+
+    seconds = benchMeasure(iterations, [&] {
+        auto root = parseXml(utf16, options);
+        benchSink += root->children.count;
+        root->document->destroy();
+    });
+    benchReport("parseXml, UTF-16 page", seconds, utf16.count());
+
+    seconds = benchMeasure(iterations, [&] {
+        ScratchScope scratch;
+        options.arena = scratch.arena;
+        benchSink += parseXml(utf16, options)->children.count;
+    });
+    benchReport("parseXml, UTF-16 page, scratch arena", seconds, utf16.count());
+    options.arena = nullptr;
+
+    delete[] utf8.chars;
+}
@@ -0,0 +1,162 @@
+#include "epub_generator.hpp"
+#include "../miniz.h"
+#include "../string.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+// xorshift32, so books don't depend on the C library's rand().
+static uint32_t nextRandom(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void addEntry(mz_zip_archive* zip, const char* name, const StringView& data, bool stored) {
+    mz_uint level = stored ? MZ_NO_COMPRESSION : MZ_DEFAULT_LEVEL;
+    verify(mz_zip_writer_add_mem_ex(zip, name, data.chars, (size_t)data.count, nullptr, 0, level, 0, 0));
+}
+
+static bool pickStored(const EPubShape& shape, uint32_t* random) {
+    return (int)(nextRandom(random) % 100) < shape.storedPercent;
+}
+
+static void appendPage(StringBuilder& page, const EPubShape& shape, int pageIndex, uint32_t* random) {
+    static const char* const words[]{ "the", "image", "viewer", "reads", "pages", "of", "a", "book", "in", "spine", "order" };
+
+    page.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    page.append("<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n");
+    page.append("<head><title>Page ").append(pageIndex).append("</title>");
+    page.append("<style>p { margin: 0 } .frame { text-align: center }</style></head>\n<body>\n");
+
+    // Images are spread between the paragraphs. Every other one is an SVG image, as in
+    // fixed-layout books.
+    int paragraphSize = 200;
+    int paragraphCount = shape.pageSize / paragraphSize;
+    if (paragraphCount < 1) {
+        paragraphCount = 1;
+    }
+    int imageIndex = 0;
+    auto appendImage = [&] {
+        if (imageIndex % 2 == 0) {
+            page.appendFormat("<div class=\"frame\"><img src=\"../Images/image-%04d-%d.jpg\" alt=\"\"/></div>\n", pageIndex, imageIndex);
+        } else {
+            page.appendFormat("<svg xmlns=\"http://www.w3.org/2000/svg\"><image xlink:href=\"../Images/image-%04d-%d.jpg\"/></svg>\n", pageIndex, imageIndex);
+        }
+        ++imageIndex;
+    };
+    for (int i = 0; i < paragraphCount; ++i) {
+        for (int depth = 0; depth < shape.nestingDepth; ++depth) {
+            page.append("<div class=\"level").append(depth).append("\">");
+        }
+        page.append("<p class=\"text\">");
+        int start = page.count;
+        while (page.count - start < paragraphSize - 60) {
+            page.append(words[nextRandom(random) % _countof(words)]).append(' ');
+        }
+        page.append("&amp; more.</p>");
+        for (int depth = 0; depth < shape.nestingDepth; ++depth) {
+            page.append("</div>");
+        }
+        page.append('\n');
+
+        while (imageIndex < shape.imagesPerPage && imageIndex * paragraphCount <= i * shape.imagesPerPage) {
+            appendImage();
+        }
+    }
+    while (imageIndex < shape.imagesPerPage) {
+        appendImage();
+    }
+    page.append("</body>\n</html>\n");
+}
+
+void generateEPub(const char* path, const EPubShape& shape) {
+    uint32_t random = shape.seed ? shape.seed : 1;
+    mz_zip_archive zip;
+    mz_zip_zero_struct(&zip);
+    verify(mz_zip_writer_init_file(&zip, path, 0));
+
+    addEntry(&zip, "mimetype", "application/epub+zip", true);
+    addEntry(&zip, "META-INF/container.xml",
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+        "  <rootfiles>\n"
+        "    <rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/>\n"
+        "  </rootfiles>\n"
+        "</container>\n", pickStored(shape, &random));
+
+    StringBuilder package;
+    package.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    package.append("<package xmlns=\"http://www.idpf.org/2007/opf\" version=\"3.0\" unique-identifier=\"id\">\n");
+    package.append("<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\"><dc:title>Generated</dc:title></metadata>\n<manifest>\n");
+    for (int i = 0; i < shape.spineLength; ++i) {
+        package.appendFormat("<item id=\"page-%04d\" href=\"Text/page-%04d.xhtml\" media-type=\"application/xhtml+xml\"/>\n", i, i);
+        for (int j = 0; j < shape.imagesPerPage; ++j) {
+            package.appendFormat("<item id=\"image-%04d-%d\" href=\"Images/image-%04d-%d.jpg\" media-type=\"image/jpeg\"/>\n", i, j, i, j);
+        }
+    }
+    package.append("</manifest>\n<spine>\n");
+    for (int i = 0; i < shape.spineLength; ++i) {
+        package.appendFormat("<itemref idref=\"page-%04d\"/>\n", i);
+    }
+    package.append("</spine>\n</package>\n");
+    addEntry(&zip, "OEBPS/content.opf", package.view(), pickStored(shape, &random));
+
+    StringBuilder page;
+    char name[64];
+    for (int i = 0; i < shape.spineLength; ++i) {
+        page.clear();
+        appendPage(page, shape, i, &random);
+        snprintf(name, sizeof(name), "OEBPS/Text/page-%04d.xhtml", i);
+        addEntry(&zip, name, page.view(), pickStored(shape, &random));
+    }
+
+    // Images are noise after a JPEG header, so deflate gains little on them, as on real images.
+    auto image = OwnedString::allocate(shape.imageSize);
+    for (int i = 0; i < shape.spineLength; ++i) {
+        for (int j = 0; j < shape.imagesPerPage; ++j) {
+            auto bytes = image.chars();
+            for (int k = 0; k < image.count(); ++k) {
+                bytes[k] = (char)nextRandom(&random);
+            }
+            memcpy(bytes, "\xFF\xD8\xFF\xE0", image.count() < 4 ? image.count() : 4);
+            snprintf(name, sizeof(name), "OEBPS/Images/image-%04d-%d.jpg", i, j);
+            addEntry(&zip, name, image, pickStored(shape, &random));
+        }
+    }
+
+    verify(mz_zip_writer_finalize_archive(&zip));
+    verify(mz_zip_writer_end(&zip));
+}
+
+bool parseEPubShapeOption(const char* option, EPubShape* shape) {
+    static const struct {
+        const char* key;
+        int EPubShape::*field;
+    } fields[]{
+        { "spine", &EPubShape::spineLength },
+        { "images", &EPubShape::imagesPerPage },
+        { "page", &EPubShape::pageSize },
+        { "depth", &EPubShape::nestingDepth },
+        { "stored", &EPubShape::storedPercent },
+        { "image-size", &EPubShape::imageSize },
+    };
+    const char* equals = strchr(option, '=');
+    if (!equals) {
+        return false;
+    }
+    size_t keyLength = (size_t)(equals - option);
+    for (const auto& field : fields) {
+        if (strlen(field.key) == keyLength && strncmp(option, field.key, keyLength) == 0) {
+            shape->*field.field = atoi(equals + 1);
+            return true;
+        }
+    }
+    if (keyLength == 4 && strncmp(option, "seed", 4) == 0) {
+        shape->seed = (uint32_t)strtoul(equals + 1, nullptr, 10);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "../common.hpp"
+#include <stdint.h>
+
+// Shape of a synthetic book. The same shape and seed always give the same book.
+struct EPubShape {
+    int spineLength = 20;
+    int imagesPerPage = 1;
+    // Approximate size of each XHTML page in bytes.
+    int pageSize = 16 * 1024;
+    // Depth of the nested divs that paragraphs are in.
+    int nestingDepth = 3;
+    // Percent of entries that are stored instead of deflated. The mimetype is always stored.
+    int storedPercent = 50;
+    int imageSize = 8 * 1024;
+    uint32_t seed = 1;
+};
+
+// Writes an EPUB with pages, images and a package document of the given shape to path.
+void generateEPub(const char* path, const EPubShape& shape);
+// Sets the shape field named by "key=value", like "spine=200". Returns false for unknown keys.
+bool parseEPubShapeOption(const char* option, EPubShape* shape);
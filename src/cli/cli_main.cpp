@@ -0,0 +1,237 @@
+#include "../common.hpp"
+#include "../arena.hpp"
+#include "../array.hpp"
+#include "../epub.hpp"
+#include "../platform.hpp"
+#include "../string.hpp"
+#include "../trace.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+
+// Batch tool on the core library, for processing books on servers with the viewer's code path.
+// Books and images that fail are reported on stderr and skipped, the exit code is 1 then.
+
+// Lines look like "<book>: <file>: <kind>: <message>", so scripts can sort failures by kind.
+// Failed verifies are bugs rather than bad books, they also get their source location.
+static void printFailure(const char* book, const StringView& fileName, const Failure& failure) {
+    fprintf(stderr, "%s", book);
+    if (fileName.count > 0) {
+        fprintf(stderr, ": %.*s", fileName.count, fileName.chars);
+    }
+    fprintf(stderr, ": %s: %s", failureKindName(failure.kind), failure.message);
+    if (failure.kind == FailureKind::Internal) {
+        fprintf(stderr, " at %s(%d)", failure.file, failure.line);
+    }
+    fprintf(stderr, "\n");
+}
+
+// Parses the book and reports its skipped spine items. Returns false if it couldn't be opened.
+static bool openBook(EPub& epub, const char* book) {
+    Failure failure;
+    if (!recoverFailures([&] { epub.parse(wrapCString(book)); }, &failure)) {
+        printFailure(book, {}, failure);
+        return false;
+    }
+    for (const auto& diagnostic : epub.diagnostics) {
+        printFailure(book, diagnostic.href, diagnostic.failure);
+    }
+    return true;
+}
+
+static int listImages(int bookCount, char** books) {
+    int result = 0;
+    for (int i = 0; i < bookCount; ++i) {
+        EPub epub;
+        bool opened = openBook(epub, books[i]);
+        if (opened) {
+            for (const auto& image : epub.images) {
+                printf("%s\t%.*s\n", books[i], image.count, image.chars);
+            }
+        }
+        if (!opened || epub.diagnostics.count > 0) {
+            result = 1;
+        }
+        epub.destroy();
+    }
+    return result;
+}
+
+static StringView fileNameOf(const StringView& path) {
+    int start = path.count;
+    while (start > 0 && path[start - 1] != '/') {
+        --start;
+    }
+    return substring(path, start, path.count - start);
+}
+
+// Entry names come from the book. Windows also separates paths with '\' and ':' names drives
+// and streams, so an entry like "..\..\x.exe" would be written outside of the directory.
+// Those characters and leading dots are replaced.
+static void appendSafeFileName(StringBuilder& path, const StringView& name) {
+    bool leading = true;
+    for (int i = 0; i < name.count; ++i) {
+        char c = name[i];
+        leading = leading && c == '.';
+        path.append(leading || c == '\\' || c == ':' ? '_' : c);
+    }
+}
+
+// Images are written in reading order as "<index>-<file name>", so names from different
+// folders of the book can't collide.
+static int extractImages(const char* book, const char* directory) {
+    EPub epub;
+    if (!openBook(epub, book)) {
+        epub.destroy();
+        return 1;
+    }
+    int result = epub.diagnostics.count > 0 ? 1 : 0;
+    int extractedCount = 0;
+    StringBuilder path;
+    for (int i = 0; i < epub.images.count; ++i) {
+        const auto& image = epub.images[i];
+        ScratchScope scratch;
+        StringView data;
+        Failure failure;
+        if (!recoverFailures([&] { data = epub.readFile(image, scratch.arena); }, &failure)) {
+            printFailure(book, image, failure);
+            result = 1;
+            continue;
+        }
+
+        path.clear();
+        path.appendFormat("%s/%04d-", directory, i);
+        appendSafeFileName(path, fileNameOf(image));
+        FILE* file = openFile(path.view(), "wb");
+        if (!file) {
+            fprintf(stderr, "Can't create %s\n", path.chars);
+            epub.destroy();
+            return 1;
+        }
+        bool written = fwrite(data.chars, 1, data.count, file) == (size_t)data.count;
+        if (fclose(file) != 0 || !written) {
+            fprintf(stderr, "Can't write %s\n", path.chars);
+            epub.destroy();
+            return 1;
+        }
+        ++extractedCount;
+    }
+    printf("%s: %d images\n", book, extractedCount);
+    epub.destroy();
+    return result;
+}
+
+static double median(double* samples, int count) {
+    std::sort(samples, samples + count);
+    return samples[count / 2];
+}
+
+// Times opening each book and reading all of its images, like paging through it in the viewer.
+// Books that can't be opened are skipped, images that can't be read are counted.
+static int benchBooks(int bookCount, char** books) {
+    const int iterations = 10;
+    double parseSamples[iterations];
+    double readSamples[iterations];
+    int result = 0;
+    for (int i = 0; i < bookCount; ++i) {
+        EPub book;
+        bool opened = openBook(book, books[i]);
+        book.destroy();
+        if (!opened) {
+            result = 1;
+            continue;
+        }
+
+        int64_t imageBytes = 0;
+        int imageCount = 0;
+        int failedCount = 0;
+        bool parseFailed = false;
+        for (int j = 0; j < iterations; ++j) {
+            EPub epub;
+            Failure failure;
+            auto start = traceTimestamp();
+            // The file can change or go away between iterations.
+            if (!recoverFailures([&] { epub.parse(wrapCString(books[i])); }, &failure)) {
+                printFailure(books[i], {}, failure);
+                epub.destroy();
+                parseFailed = true;
+                break;
+            }
+            auto parsed = traceTimestamp();
+            imageBytes = 0;
+            failedCount = 0;
+            for (const auto& image : epub.images) {
+                ScratchScope scratch;
+                Failure failure;
+                if (!recoverFailures([&] { imageBytes += epub.readFile(image, scratch.arena).count; }, &failure)) {
+                    ++failedCount;
+                }
+            }
+            auto read = traceTimestamp();
+            imageCount = epub.images.count;
+            epub.destroy();
+            parseSamples[j] = (parsed - start) / 1e6;
+            readSamples[j] = (read - parsed) / 1e6;
+        }
+        if (parseFailed) {
+            result = 1;
+            continue;
+        }
+        double readMs = median(readSamples, iterations);
+        printf("%s: %d images, parse %.3f ms, read %.3f ms, %.1f MB/s\n", books[i], imageCount, median(parseSamples, iterations), readMs,
+            readMs > 0 ? imageBytes / (readMs / 1000.0) / (1024.0 * 1024.0) : 0.0);
+        if (failedCount > 0) {
+            fprintf(stderr, "%s: %d images couldn't be read\n", books[i], failedCount);
+            result = 1;
+        }
+    }
+    return result;
+}
+
+static int printUsage() {
+    fprintf(stderr,
+        "Usage:\n"
+        "  BookViewCli list <books...>              image paths of each book in reading order\n"
+        "  BookViewCli extract <book> <directory>   writes the images of a book to an existing directory\n"
+        "  BookViewCli bench <books...>             median time to open each book and read its images\n");
+    return 2;
+}
+
+static int run(int argc, char** argv) {
+    if (argc < 3) {
+        return printUsage();
+    }
+    if (strcmp(argv[1], "list") == 0) {
+        return listImages(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "extract") == 0 && argc == 4) {
+        return extractImages(argv[2], argv[3]);
+    }
+    if (strcmp(argv[1], "bench") == 0) {
+        return benchBooks(argc - 2, argv + 2);
+    }
+    return printUsage();
+}
+
+#ifdef _WIN32
+// main gets the arguments in the ANSI code page, which can't name every book. They are taken
+// as UTF-16 instead and converted to UTF-8 like all other paths.
+int wmain(int argc, wchar_t** wideArgv) {
+    Arena arena;
+    auto argv = (char**)arena.allocate(sizeof(char*) * (argc + 1));
+    for (int i = 0; i < argc; ++i) {
+        auto arg = toUtf8(wideArgv[i], wcslen(wideArgv[i]));
+        argv[i] = arena.allocateString(arg.count() + 1).chars;
+        memcpy(argv[i], arg.chars(), arg.count() + 1);
+    }
+    argv[argc] = nullptr;
+    int result = run(argc, argv);
+    arena.destroy();
+    return result;
+}
+#else
+int main(int argc, char** argv) {
+    return run(argc, argv);
+}
+#endif
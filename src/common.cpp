@@ -1,12 +1,49 @@
 #include "common.hpp"
+#include "platform.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 
-extern HWND hwnd;
+// Number of recoverFailures calls that are running on this thread.
+static thread_local int recoverableDepth = 0;
+
+RecoverableScope::RecoverableScope() {
+    ++recoverableDepth;
+}
+
+RecoverableScope::~RecoverableScope() {
+    --recoverableDepth;
+}
+
+bool failuresAreRecoverable() {
+    return recoverableDepth > 0;
+}
+
+const char* failureKindName(FailureKind kind) {
+    switch (kind) {
+        case FailureKind::Internal: return "internal";
+        case FailureKind::Io: return "io";
+        case FailureKind::NotZip: return "not-zip";
+        case FailureKind::DamagedZip: return "damaged-zip";
+        case FailureKind::MissingEntry: return "missing-entry";
+        case FailureKind::MalformedXml: return "malformed-xml";
+    }
+    return "unknown";
+}
 
 void verifyImpl(const char* msg, const char* file, int line) {
+    failImpl(FailureKind::Internal, msg, file, line);
+}
+
+void failImpl(FailureKind kind, const char* message, const char* file, int line) {
+    if (recoverableDepth > 0) {
+        throw Failure{ kind, message, file, line };
+    }
     char buffer[1024];
-    sprintf_s(buffer, "Assertion failed at %s(%d): %s", file, line, msg);
-    MessageBoxA(hwnd, buffer, "Assertion failed", MB_ICONERROR);
+    if (kind == FailureKind::Internal) {
+        snprintf(buffer, sizeof(buffer), "Assertion failed at %s(%d): %s", file, line, message);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%s at %s(%d)", message, file, line);
+    }
+    reportFailure(buffer);
     exit(1);
 }
@@ -1,29 +1,90 @@
 #pragma once
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <Windows.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
-__declspec(noreturn) void verifyImpl(const char* msg, const char* file, int line);
+// What a failure was caused by, so callers that process many books can tell damaged books
+// apart from each other and from bugs.
+enum class FailureKind {
+    Internal,     // A verify failed, the message is its condition.
+    Io,           // A file couldn't be opened, read or written.
+    NotZip,       // The book isn't a zip archive.
+    DamagedZip,   // A zip entry can't be extracted.
+    MissingEntry, // A file or manifest item that the book refers to doesn't exist.
+    MalformedXml, // A document isn't well-formed XML.
+};
+
+// Short name like "malformed-xml", for output that is read by scripts.
+const char* failureKindName(FailureKind kind);
+
+[[noreturn]] void verifyImpl(const char* msg, const char* file, int line);
+[[noreturn]] void failImpl(FailureKind kind, const char* message, const char* file, int line);
+
+// A failed verify or input check. While failures are recoverable, see recoverFailures, they
+// throw it instead of exiting.
+struct Failure {
+    FailureKind kind = FailureKind::Internal;
+    // Readable description of the problem, or the condition of a failed verify.
+    const char* message = nullptr;
+    const char* file = nullptr;
+    int line = 0;
+};
+
+// Makes failures on this thread recoverable while it exists, used by recoverFailures.
+struct RecoverableScope {
+    RecoverableScope();
+    ~RecoverableScope();
+};
 
-#ifdef _DEBUG
-#define verify(cond) do { if (!(cond)) __debugbreak(); } while (0)
+bool failuresAreRecoverable();
+
+// Runs body and returns true, or returns false with the failure if a check in it failed. Books,
+// their files and XML documents are checked with verifyInput, so malformed ones fail this way
+// and callers that process many of them can skip the bad ones. Whatever body was building is left
+// partially filled and still has to be destroyed. Exceptions cost nothing until one is thrown,
+// so the successful path is as fast as calling body.
+template<typename F>
+bool recoverFailures(F body, Failure* failure) {
+    RecoverableScope scope;
+    try {
+        body();
+    } catch (const Failure& caught) {
+        *failure = caught;
+        return false;
+    }
+    return true;
+}
+
+#if defined(_DEBUG) && defined(_MSC_VER)
+#define verify(cond) do { if (!(cond)) { if (!failuresAreRecoverable()) __debugbreak(); verifyImpl(#cond, __FILE__, __LINE__); } } while (0)
 #else
 #define verify(cond) do { if (!(cond)) verifyImpl(#cond, __FILE__, __LINE__); } while (0)
 #endif
 
-struct String {
+// Checks input like books, their files and documents. verify is for internal invariants, its
+// condition is no help to someone whose book failed to open.
+#define verifyInput(cond, kind, message) do { if (!(cond)) failImpl(kind, message, __FILE__, __LINE__); } while (0)
+
+// The MSVC C library has _countof, others get the same compile time array length.
+#ifndef _countof
+template<typename T, size_t N> char (&countOfHelper(T (&)[N]))[N];
+#define _countof(array) sizeof(countOfHelper(array))
+#endif
+
+// Borrowed string, doesn't own or free its characters. Views usually point into a document,
+// an arena or an OwnedString that outlives them.
+struct StringView {
     char* chars;
     int count;
 
-    inline void destroy() { delete[] chars; chars = nullptr; count = 0; }
     inline bool isEmpty() const { return chars == nullptr || count <= 0; }
     inline char operator[](size_t i) const { return chars[i]; }
 
-    inline String(char* chars, int count) : chars(chars), count(count) { }
-    inline String() : chars(nullptr), count(0) { }
-    template<size_t N> constexpr String(const char(&a)[N]) : chars((char*)a), count(N - 1) { }
+    inline StringView(char* chars, int count) : chars(chars), count(count) { }
+    inline StringView() : chars(nullptr), count(0) { }
+    template<size_t N> constexpr StringView(const char(&a)[N]) : chars((char*)a), count(N - 1) { }
 };
 
-inline String wrapCString(const char* str) {
-    return String{ (char*)str, str ? (int)strlen(str) : 0 };
+inline StringView wrapCString(const char* str) {
+    return StringView{ (char*)str, str ? (int)strlen(str) : 0 };
 }
@@ -2,135 +2,134 @@
 #include "epub.hpp"
 #include "miniz.h"
 #include "xml.hpp"
+#include "xmlquery.hpp"
+#include "utf.hpp"
 #include "string.hpp"
 #include "array.hpp"
+#include "memory.hpp"
+#include "platform.hpp"
+#include "trace.hpp"
+#include <limits.h>
 
-static String removeLastPathComponent(const String& path) {
+static StringView removeLastPathComponent(const StringView& path) {
     int slashIndex = lastIndexOf(path, '/');
-    return slashIndex == -1 ? copyString("") : substring(path, 0, slashIndex);
+    return slashIndex == -1 ? "" : substring(path, 0, slashIndex);
 }
 
-static void splitPathIntoComponents(const String& path, Array<String>& components) {
-    int lastComponentEndIndex = 0;
-    for (int i = 0; i <= path.count; ++i) {
-        char c = i < path.count ? path[i] : '/';
-        if (c == '/') {
-            int componentCharacterCount = i - lastComponentEndIndex;
-            if (componentCharacterCount > 0) {
-                components.push(substring(path, lastComponentEndIndex, componentCharacterCount));
-            }
-            lastComponentEndIndex = i + 1;
-        }
-    }
-}
-
-static String combinePath(const Array<String>& components) {
-    if (components.count == 0) {
-        return copyString("");
-    }
-    int count = components.count - 1;
-    for (const auto& component : components) {
-        count += component.count;
-    }
-    auto memory = new char[count];
-    auto now = memory;
-    for (int i = 0; i < components.count; ++i) {
-        const auto& component = components[i];
-        memcpy(now, component.chars, component.count);
-        now += component.count;
-        if (i != components.count - 1) *now++ = '/';
-    }
-    return { memory, count };
-}
-
-static String resolveRelativePath(const String& currentDirectory, const String& targetFilePath) {
-    Array<String> components;
-    splitPathIntoComponents(currentDirectory, components);
-    splitPathIntoComponents(targetFilePath, components);
-
-    for (int i = 0; i < components.count; ++i) {
-        const auto& component = components[i];
-        if (component == "..") {
-            verify(i >= 1);
-            components.removeAt(i);
-            components.removeAt(i - 1);
-            i -= 2;
-        }
-    }
-
-    return combinePath(components);
-}
-
-static void parseContent(EPub& epub, const String& content, const String& currentDirectory) {
-    auto root = parseXml(content);
+static void parseContent(EPub& epub, const StringView& content, const StringView& currentDirectory) {
+    TraceSpan span("parseContent");
+    static const XmlQuery itemIdQuery = compileXmlQuery("package/manifest/item/@id");
+    static const XmlQuery itemHrefQuery = compileXmlQuery("package/manifest/item/@href");
+    static const XmlQuery itemMediaTypeQuery = compileXmlQuery("package/manifest/item/@media-type");
+    static const XmlQuery itemrefIdQuery = compileXmlQuery("package/spine/itemref/@idref");
+    // Every matched element gives a result, so these tell whether the manifest and spine are there.
+    static const XmlQuery manifestQuery = compileXmlQuery("package/manifest/@id");
+    static const XmlQuery spineQuery = compileXmlQuery("package/spine/@toc");
+    static const XmlQuery* const queries[]{ &itemIdQuery, &itemHrefQuery, &itemMediaTypeQuery, &itemrefIdQuery, &manifestQuery, &spineQuery };
 
-    auto manifest = root->element("manifest");
-    verify(manifest);
+    XmlQueryResults<_countof(queries)> results;
+    runXmlQueries(content, queries, results.arrays, _countof(queries), &epub.arena);
+    const auto& itemIds = results[0];
+    const auto& itemHrefs = results[1];
+    const auto& itemMediaTypes = results[2];
+    const auto& itemrefIds = results[3];
+    verifyInput(results[4].count > 0, FailureKind::MalformedXml, "Package document has no manifest");
+    verifyInput(results[5].count > 0, FailureKind::MalformedXml, "Package document has no spine");
 
-    auto items = manifest->findElements("item");
-    for (auto& item : items) {
-        auto parsedItem = new EPubItem();
-        parsedItem->id = item->attr("id");
-        parsedItem->href = resolveRelativePath(currentDirectory, item->attr("href"));
-        parsedItem->mediaType = item->attr("media-type");
+    epub.items.reserve(epub.items.count + itemIds.count);
+    epub.itemsById.reserve(epub.itemsById.count + itemIds.count);
+    for (int i = 0; i < itemIds.count; ++i) {
+        auto parsedItem = epub.arena.create<EPubItem>();
+        parsedItem->id = itemIds[i];
+        parsedItem->href = resolveRelativePath(currentDirectory, itemHrefs[i], &epub.arena);
+        parsedItem->mediaType = itemMediaTypes[i];
         epub.items.push(parsedItem);
+        if (!epub.itemsById.contains(parsedItem->id)) {
+            epub.itemsById.insert(parsedItem->id, parsedItem);
+        }
     }
 
-    auto spine = root->element("spine");
-    verify(spine);
-
-    auto itemrefs = spine->findElements("itemref");
-    for (auto& itemref : itemrefs) {
-        auto idref = itemref->attr("idref");
+    epub.linearItemOrder.reserve(epub.linearItemOrder.count + itemrefIds.count);
+    for (const auto& idref : itemrefIds) {
         auto item = epub.getItemById(idref);
-        verify(item);
+        if (!item) {
+            Failure failure{ FailureKind::MissingEntry, "Spine item is not in the manifest", __FILE__, __LINE__ };
+            epub.diagnostics.push({ idref, failure });
+            continue;
+        }
         epub.linearItemOrder.push(item);
     }
 }
 
-static void collectImage(EPub& epub, const String& src) {
-    for (const auto& image : epub.images) {
-        if (stringEqualsCaseInsensitive(image, src)) {
-            return;
-        }
+static void collectImage(EPub& epub, const StringView& src) {
+    if (epub.imageSet.add(src)) {
+        epub.images.push(src);
     }
-    epub.images.push(src);
 }
 
-static void collectPageImages(EPub& epub, const String& content, const String& currentDirectory) {
-    auto root = parseXml(content);
+static void collectPageImages(EPub& epub, XmlElement* root, const StringView& currentDirectory) {
+    TraceSpan span("collectPageImages");
 
     // <img src="..." />
     // <image xlink:href="..." />
 
-    String tagNames[]{ "img", "image" };
-    auto images = root->getElementsByTagNames(tagNames, _countof(tagNames));
+    static const StringView tagNames[]{ "img", "image" };
+    XmlTagSet imageTags;
+    imageTags.init(tagNames, _countof(tagNames));
+    SmallArray<XmlElement*, 32> images;
+    root->getElementsByTagNames(imageTags, images);
+    int xlinkNamespace = root->document->findNamespace("http://www.w3.org/1999/xlink");
 
     for (const auto& image : images) {
-        String imageUrl;
-        if (image->name == "img") {
+        StringView imageUrl;
+        if (stringEqualsCaseInsensitive(image->name, "img")) {
             imageUrl = image->attr("src");
-        } else if (image->name == "image") {
-            imageUrl = image->attr("xlink:href");
+        } else if (stringEqualsCaseInsensitive(image->name, "image")) {
+            // XLink may be bound to any prefix, pages that never declare it use "xlink:".
+            imageUrl = xlinkNamespace == -1 ? image->attr("xlink:href") : image->attr(xlinkNamespace, "href");
+            if (imageUrl.count == 0) {
+                imageUrl = image->attr("href"); // SVG 2
+            }
         } else {
             verify(false);
         }
 
-        if (imageUrl.count == 0) continue;
-        collectImage(epub, resolveRelativePath(currentDirectory, imageUrl));
+        auto imagePath = resolveRelativePath(currentDirectory, imageUrl, &epub.arena);
+        if (imagePath.count == 0) continue;
+        collectImage(epub, imagePath);
     }
+    images.destroy();
+}
+
+EPubItem* EPub::getItemById(const StringView& id) {
+    auto item = itemsById.find(id);
+    return item ? *item : nullptr;
 }
 
-EPubItem* EPub::getItemById(const String& id) {
-    for (auto& item : items) {
-        if (item->id == id) {
-            return item;
+static void indexArchive(EPub& epub) {
+    mz_uint fileCount = mz_zip_reader_get_num_files(&epub.zip);
+    epub.fileIndices.reserve((int)fileCount);
+    for (mz_uint i = 0; i < fileCount; ++i) {
+        mz_uint size = mz_zip_reader_get_filename(&epub.zip, i, nullptr, 0);
+        verify(size > 0);
+        auto name = epub.arena.allocateString((int)size);
+        mz_zip_reader_get_filename(&epub.zip, i, name.chars, size);
+        name.count = (int)size - 1;
+        // The first of entries with the same name wins, like in mz_zip_reader_locate_file.
+        if (!epub.fileIndices.contains(name)) {
+            epub.fileIndices.insert(name, i);
         }
     }
-    return nullptr;
 }
 
-static String discoverContentRoot(EPub& epub) {
+mz_uint32 EPub::locateFile(const StringView& fileName) {
+    auto index = fileIndices.find(fileName);
+    verifyInput(index, FailureKind::MissingEntry, "File is missing from the book");
+    return *index;
+}
+
+static StringView discoverContentRoot(EPub& epub) {
+    TraceSpan span("discoverContentRoot");
     /*
         <?xml version="1.0" encoding="UTF-8"?>
         <container version="1.0" xmlns="urn:oasis:names:tc:opendocument:xmlns:container">
@@ -139,54 +138,211 @@ static String discoverContentRoot(EPub& epub) {
             </rootfiles>
         </container>
     */
-    auto file = epub.readFile("META-INF/container.xml");
-    auto content = parseXml(file);
-    auto rootFiles = content->getElementsByTagName("rootfile");
-    for (const auto& rootFile : rootFiles) {
-        if (rootFile->attr("media-type") == "application/oebps-package+xml") {
-            auto fullPath = rootFile->attr("full-path");
-            int slashIndex = indexOf(fullPath, '/');
-            epub.contentRootFolder = copyString(slashIndex == -1 ? "" : substring(fullPath, 0, slashIndex));
-            return fullPath;
+    ScratchScope scratch;
+    auto file = epub.readFile("META-INF/container.xml", scratch.arena);
+    static const XmlQuery fullPathQuery = compileXmlQuery("container/rootfiles/rootfile/@full-path");
+    static const XmlQuery mediaTypeQuery = compileXmlQuery("container/rootfiles/rootfile/@media-type");
+    static const XmlQuery* const queries[]{ &fullPathQuery, &mediaTypeQuery };
+
+    XmlQueryResults<_countof(queries)> results;
+    runXmlQueries(file, queries, results.arrays, _countof(queries), &epub.arena);
+    const auto& fullPaths = results[0];
+    const auto& mediaTypes = results[1];
+
+    StringView fullPath;
+    for (int i = 0; i < fullPaths.count; ++i) {
+        if (mediaTypes[i] == "application/oebps-package+xml") {
+            // Results point into the file, which is released on return.
+            fullPath = copyString(fullPaths[i], &epub.arena);
+            break;
         }
     }
-    verify(!"Could not find content root file.");
-    return {};
+
+    verifyInput(fullPath.count > 0, FailureKind::MissingEntry, "Container doesn't name a package document");
+    int slashIndex = indexOf(fullPath, '/');
+    epub.contentRootFolder = slashIndex == -1 ? "" : substring(fullPath, 0, slashIndex);
+    return fullPath;
+}
+
+// miniz allocates its state and inflate buffers through these, so they are counted too.
+static void* zipAllocate(void*, size_t items, size_t size) {
+    return memoryAllocate(items * size);
 }
 
-void EPub::parse(const String& fileName) {
+static void* zipReallocate(void*, void* address, size_t items, size_t size) {
+    return memoryReallocate(address, items * size);
+}
+
+static void zipFree(void*, void* address) {
+    memoryFree(address);
+}
+
+void EPub::parse(const StringView& fileName) {
+    TraceSpan span("EPub::parse");
+    MemoryPhaseScope phase(MemoryPhase::OpenBook);
     mz_zip_zero_struct(&zip);
+    zip.m_pAlloc = zipAllocate;
+    zip.m_pRealloc = zipReallocate;
+    zip.m_pFree = zipFree;
 
-    this->fileName = copyString(fileName);
+    this->fileName = OwnedString(fileName);
     
-    wchar_t* wideFileName = toUtf16(fileName, nullptr);
-    FILE* file = nullptr;
-    verify(0 == _wfopen_s(&file, wideFileName, L"rb"));
+    file = openFile(fileName, "rb");
+    verifyInput(file, FailureKind::Io, "Can't open the file");
 
-    verify(mz_zip_reader_init_cfile(&zip, file, 0, 0));
+    verifyInput(mz_zip_reader_init_cfile(&zip, file, 0, 0), FailureKind::NotZip, "Not a zip archive");
+    indexArchive(*this);
 
     auto contentRootFile = discoverContentRoot(*this);
-    auto content = readFile(contentRootFile);
-    parseContent(*this, content, removeLastPathComponent(contentRootFile));
+    packageDocument = readFile(contentRootFile);
+    parseContent(*this, packageDocument, removeLastPathComponent(contentRootFile));
+
+    // Images are never inside these elements, so they are skipped without tokenizing.
+    static const StringView pageSkipElements[]{ "head", "style", "script" };
+    XmlParseOptions pageOptions;
+    pageOptions.skipElements = pageSkipElements;
+    pageOptions.skipElementCount = _countof(pageSkipElements);
+    pageOptions.dropWhiteSpaceText = true;
 
     for (const auto& item : linearItemOrder) {
-        auto page = readFile(item->href);
-        collectPageImages(*this, page, removeLastPathComponent(item->href));
+        // Page trees are only used to collect image paths, which are copied into the arena.
+        ScratchScope scratch;
+        pageOptions.arena = scratch.arena;
+        Failure failure;
+        bool parsed = recoverFailures([&] {
+            auto page = readXmlFile(item->href, pageOptions);
+            collectPageImages(*this, page, removeLastPathComponent(item->href));
+        }, &failure);
+        if (!parsed) {
+            diagnostics.push({ item->href, failure });
+        }
     }
 }
 
-String EPub::readFile(const String& fileName) {
-    auto normalizedFileName = toCString(fileName);
-    size_t size;
-    void* data = mz_zip_reader_extract_file_to_heap(&zip, normalizedFileName, &size, 0);
-    verify(data);
-    delete[] normalizedFileName;
-    return { (char*)data, (int)size };
+OwnedString EPub::readFile(const StringView& fileName) {
+    TraceSpan span("EPub::readFile");
+    MemoryPhaseScope phase(MemoryPhase::ReadFile);
+    mz_uint32 fileIndex = locateFile(fileName);
+    mz_zip_archive_file_stat stat;
+    verify(mz_zip_reader_file_stat(&zip, fileIndex, &stat));
+    verify(stat.m_uncomp_size < INT_MAX);
+
+    auto result = OwnedString::allocate((int)stat.m_uncomp_size);
+    verifyInput(mz_zip_reader_extract_to_mem(&zip, fileIndex, result.chars(), result.count(), 0), FailureKind::DamagedZip, "Can't extract the file");
+    return result;
+}
+
+StringView EPub::readFile(const StringView& fileName, Arena* arena) {
+    TraceSpan span("EPub::readFile");
+    MemoryPhaseScope phase(MemoryPhase::ReadFile);
+    mz_uint32 fileIndex = locateFile(fileName);
+    mz_zip_archive_file_stat stat;
+    verify(mz_zip_reader_file_stat(&zip, fileIndex, &stat));
+    verify(stat.m_uncomp_size < INT_MAX);
+
+    auto result = arena->allocateString((int)stat.m_uncomp_size);
+    verifyInput(mz_zip_reader_extract_to_mem(&zip, fileIndex, result.chars, result.count, 0), FailureKind::DamagedZip, "Can't extract the file");
+    return result;
+}
+
+// Frees the extract iterator also when reading fails, it holds the inflate buffers.
+struct ExtractIterScope {
+    mz_zip_reader_extract_iter_state* iter;
+    ~ExtractIterScope() {
+        if (iter) {
+            mz_zip_reader_extract_iter_free(iter);
+        }
+    }
+
+    // Frees the iterator, which fails if the data didn't match its CRC.
+    bool free() {
+        bool succeeded = mz_zip_reader_extract_iter_free(iter) != 0;
+        iter = nullptr;
+        return succeeded;
+    }
+};
+
+XmlElement* EPub::readXmlFile(const StringView& fileName, const XmlParseOptions& parseOptions) {
+    TraceSpan span("EPub::readXmlFile");
+    MemoryPhaseScope phase(MemoryPhase::ReadFile);
+    // The text that the tree points into is allocated in the document's arena.
+    XmlDocumentScope document(parseOptions);
+    const auto& options = document.options;
+    mz_uint32 fileIndex = locateFile(fileName);
+
+    mz_zip_archive_file_stat stat;
+    verify(mz_zip_reader_file_stat(&zip, fileIndex, &stat));
+    verify(stat.m_uncomp_size <= INT_MAX);
+    int size = (int)stat.m_uncomp_size;
+
+    if (options.parallelMinSize > 0 && size >= options.parallelMinSize) {
+        // Large documents are tokenized on multiple threads, which needs the whole document.
+        auto data = options.arena->allocateString(size).chars;
+        verifyInput(mz_zip_reader_extract_to_mem(&zip, fileIndex, data, size, 0), FailureKind::DamagedZip, "Can't extract the file");
+        return document.release(parseXml({ data, size }, options));
+    }
+
+    ExtractIterScope scope{ mz_zip_reader_extract_iter_new(&zip, fileIndex, 0) };
+    auto iter = scope.iter;
+    verifyInput(iter, FailureKind::DamagedZip, "Can't extract the file");
+
+    // Look at the first bytes to find out the encoding before choosing how to parse.
+    char head[4];
+    int headSize = size < (int)sizeof(head) ? size : (int)sizeof(head);
+    verifyInput(mz_zip_reader_extract_iter_read(iter, head, headSize) == (size_t)headSize, FailureKind::DamagedZip, "Can't extract the file");
+    int bomSize;
+    auto encoding = detectXmlEncoding(head, headSize, &bomSize);
+
+    if (encoding != TextEncoding::Utf8) {
+        // UTF-16 can't be tokenized while streaming, the whole document is inflated and then
+        // transcoded. Without an arena, the buffer is reused for every such document.
+        char* data;
+        if (parseOptions.arena) {
+            data = options.arena->allocateString(size).chars;
+        } else {
+            readBuffer.reserve(size);
+            data = readBuffer.data;
+        }
+        memcpy(data, head, headSize);
+        if (size > headSize) {
+            verifyInput(mz_zip_reader_extract_iter_read(iter, data + headSize, size - headSize) == (size_t)(size - headSize), FailureKind::DamagedZip, "Can't extract the file");
+        }
+        verifyInput(scope.free(), FailureKind::DamagedZip, "File doesn't match its checksum");
+        return document.release(parseXml({ data, size }, options));
+    }
+
+    // Inflate straight into the parser's buffer and tokenize each chunk while it is still hot
+    // in cache, instead of inflating the whole page first.
+    const int chunkSize = 32 * 1024;
+    XmlStreamParser parser;
+    parser.init(options.arena->allocateString(size - bomSize).chars, size - bomSize, options);
+    parser.write(head + bomSize, headSize - bomSize);
+    while (parser.count < parser.capacity) {
+        int remaining = parser.capacity - parser.count;
+        size_t read = mz_zip_reader_extract_iter_read(iter, parser.buffer + parser.count, remaining < chunkSize ? remaining : chunkSize);
+        verifyInput(read > 0, FailureKind::DamagedZip, "Can't extract the file");
+        parser.commit((int)read);
+    }
+    verifyInput(scope.free(), FailureKind::DamagedZip, "File doesn't match its checksum");
+
+    return document.release(parser.finish());
 }
 
 void EPub::destroy() {
     mz_zip_end(&zip);
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    fileName.destroy();
+    packageDocument.destroy();
     items.destroy();
     linearItemOrder.destroy();
     images.destroy();
+    diagnostics.destroy();
+    itemsById.destroy();
+    imageSet.destroy();
+    fileIndices.destroy();
+    readBuffer.destroy();
+    arena.destroy();
 }
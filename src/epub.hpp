@@ -2,23 +2,57 @@
 #include "common.hpp"
 #include "miniz.h"
 #include "array.hpp"
+#include "arena.hpp"
+#include "hash.hpp"
+#include "string.hpp"
+
+struct XmlElement;
+struct XmlParseOptions;
 
 struct EPubItem {
-    String id;
-    String href;
-    String mediaType;
+    StringView id;
+    StringView href;
+    StringView mediaType;
+};
+
+// A spine item that was skipped because it couldn't be read or parsed.
+struct EPubDiagnostic {
+    // Path of the item, or its idref when the manifest doesn't have it.
+    StringView href;
+    Failure failure;
 };
 
+// Strings of items and images are views into packageDocument or arena.
+//
+// Malformed books fail with verify, see recoverFailures. Broken spine items don't fail the
+// book, they are skipped and listed in diagnostics.
 struct EPub {
-    String fileName;
-    String contentRootFolder;
+    OwnedString fileName;
+    StringView contentRootFolder;
+    OwnedString packageDocument;
     Array<EPubItem*> items;
     Array<EPubItem*> linearItemOrder;
-    Array<String> images;
+    Array<StringView> images;
+    Array<EPubDiagnostic> diagnostics;
+    HashMap<StringView, EPubItem*> itemsById;
+    HashSet<StringView, CaseInsensitiveStringHashTraits> imageSet;
+    // Zip entry names, matched ignoring case like miniz does.
+    HashMap<StringView, mz_uint32, CaseInsensitiveStringHashTraits> fileIndices;
+    // Strings that had to be decoded from the package documents.
+    Arena arena;
+    // Reused for inflating documents that can't be parsed while streaming.
+    Array<char> readBuffer;
     mz_zip_archive zip;
+    // miniz doesn't close files that it was given open.
+    FILE* file = nullptr;
 
-    EPubItem* getItemById(const String& id);
-    void parse(const String& fileName);
-    String readFile(const String& fileName);
+    EPubItem* getItemById(const StringView& id);
+    void parse(const StringView& fileName);
+    mz_uint32 locateFile(const StringView& fileName);
+    OwnedString readFile(const StringView& fileName);
+    StringView readFile(const StringView& fileName, Arena* arena);
+    // The document is read into options.arena when it is set, otherwise free the tree with
+    // root->document->destroy().
+    XmlElement* readXmlFile(const StringView& fileName, const XmlParseOptions& options);
     void destroy();
 };
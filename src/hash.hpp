@@ -0,0 +1,194 @@
+#pragma once
+#include "common.hpp"
+#include "string.hpp"
+#include <stdint.h>
+
+// Hash and equality of keys. Specialize for new key types, or pass another traits type to
+// HashMap, e.g. CaseInsensitiveStringHashTraits.
+template<typename K>
+struct HashTraits;
+
+template<>
+struct HashTraits<StringView> {
+    static uint64_t hash(const StringView& key) { return hashString(key); }
+    static bool equals(const StringView& a, const StringView& b) { return stringEquals(a, b); }
+};
+
+struct CaseInsensitiveStringHashTraits {
+    static uint64_t hash(const StringView& key) { return hashStringCaseInsensitive(key); }
+    static bool equals(const StringView& a, const StringView& b) { return stringEqualsCaseInsensitive(a, b); }
+};
+
+template<typename T>
+struct HashTraits<T*> {
+    static uint64_t hash(T* key) {
+        uint64_t value = (uint64_t)(uintptr_t)key * 0x9E3779B97F4A7C15ull;
+        return value ^ (value >> 32);
+    }
+    static bool equals(T* a, T* b) { return a == b; }
+};
+
+template<>
+struct HashTraits<int> {
+    static uint64_t hash(int key) {
+        uint64_t value = (uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ull;
+        return value ^ (value >> 32);
+    }
+    static bool equals(int a, int b) { return a == b; }
+};
+
+// Open addressing hash map with linear probing. Slots keep 32 bits of the key hash, so probes
+// compare keys only when hashes match, and removal shifts following entries back instead of
+// leaving tombstones. Keys and values are copied like Array elements.
+template<typename K, typename V, typename Traits = HashTraits<K>>
+struct HashMap {
+    struct Slot {
+        uint32_t hash; // 0 for empty slots.
+        K key;
+        V value;
+    };
+
+    Slot* slots = nullptr;
+    int count = 0;
+    int capacity = 0; // Power of two.
+
+    V* find(const K& key) const {
+        if (count == 0) {
+            return nullptr;
+        }
+        uint32_t hash = slotHash(key);
+        uint32_t mask = (uint32_t)capacity - 1;
+        for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.hash == 0) {
+                return nullptr;
+            }
+            if (slot.hash == hash && Traits::equals(slot.key, key)) {
+                return &slot.value;
+            }
+        }
+    }
+
+    bool contains(const K& key) const {
+        return find(key) != nullptr;
+    }
+
+    // Inserts or replaces the value of key. Returns true if key was not in the map.
+    bool insert(const K& key, const V& value) {
+        reserve(count + 1);
+        uint32_t hash = slotHash(key);
+        uint32_t mask = (uint32_t)capacity - 1;
+        for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+            Slot& slot = slots[i];
+            if (slot.hash == 0) {
+                slot.hash = hash;
+                slot.key = key;
+                slot.value = value;
+                ++count;
+                return true;
+            }
+            if (slot.hash == hash && Traits::equals(slot.key, key)) {
+                slot.value = value;
+                return false;
+            }
+        }
+    }
+
+    bool remove(const K& key) {
+        if (count == 0) {
+            return false;
+        }
+        uint32_t hash = slotHash(key);
+        uint32_t mask = (uint32_t)capacity - 1;
+        uint32_t i = hash & mask;
+        while (true) {
+            if (slots[i].hash == 0) {
+                return false;
+            }
+            if (slots[i].hash == hash && Traits::equals(slots[i].key, key)) {
+                break;
+            }
+            i = (i + 1) & mask;
+        }
+
+        // Move back entries that were displaced past the removed one.
+        uint32_t hole = i;
+        for (uint32_t j = (i + 1) & mask; slots[j].hash != 0; j = (j + 1) & mask) {
+            uint32_t home = slots[j].hash & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole].hash = 0;
+        --count;
+        return true;
+    }
+
+    // Makes room for newCount entries without rehashing, keeping the load factor below 3/4.
+    void reserve(int newCount) {
+        if (newCount * 4 < capacity * 3) {
+            return;
+        }
+        int newCapacity = capacity < 8 ? 8 : capacity;
+        while (newCount * 4 >= newCapacity * 3) {
+            newCapacity *= 2;
+        }
+
+        Slot* oldSlots = slots;
+        int oldCapacity = capacity;
+        slots = new Slot[newCapacity];
+        capacity = newCapacity;
+        for (int i = 0; i < capacity; ++i) {
+            slots[i].hash = 0;
+        }
+
+        uint32_t mask = (uint32_t)capacity - 1;
+        for (int i = 0; i < oldCapacity; ++i) {
+            if (oldSlots[i].hash == 0) {
+                continue;
+            }
+            uint32_t j = oldSlots[i].hash & mask;
+            while (slots[j].hash != 0) {
+                j = (j + 1) & mask;
+            }
+            slots[j] = oldSlots[i];
+        }
+        delete[] oldSlots;
+    }
+
+    void clear() {
+        for (int i = 0; i < capacity; ++i) {
+            slots[i].hash = 0;
+        }
+        count = 0;
+    }
+
+    void destroy() {
+        delete[] slots;
+        slots = nullptr;
+        count = 0;
+        capacity = 0;
+    }
+
+private:
+    static uint32_t slotHash(const K& key) {
+        uint64_t hash = Traits::hash(key);
+        uint32_t result = (uint32_t)(hash ^ (hash >> 32));
+        return result ? result : 1;
+    }
+};
+
+template<typename K, typename Traits = HashTraits<K>>
+struct HashSet {
+    HashMap<K, bool, Traits> map;
+
+    int count() const { return map.count; }
+    bool contains(const K& key) const { return map.contains(key); }
+    // Returns true if key was not in the set.
+    bool add(const K& key) { return map.insert(key, true); }
+    bool remove(const K& key) { return map.remove(key); }
+    void reserve(int newCount) { map.reserve(newCount); }
+    void clear() { map.clear(); }
+    void destroy() { map.destroy(); }
+};
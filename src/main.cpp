@@ -1,3 +1,4 @@
+#include <Windows.h>
 #include <d2d1.h>
 #include <shellapi.h>
 #include <dwrite.h>
@@ -7,18 +8,23 @@
 #include "epub.hpp"
 #include "string.hpp"
 #include "array.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+#include <stdio.h>
 
 #pragma comment(lib, "d2d1.lib")
 #pragma comment(lib, "windowscodecs.lib")
 #pragma comment(lib, "shlwapi.lib")
 
 struct Image {
-    String fileName;
+    StringView fileName;
     ID2D1Bitmap* bitmap = nullptr;
     float width = 0;
     float height = 0;
     int clientWidth = 0;
     int clientHeight = 0;
+    // Images that can't be read or decoded are drawn as an empty page.
+    bool failed = false;
 };
 
 HWND hwnd = 0;
@@ -33,9 +39,18 @@ static void initWindow(HINSTANCE hInstance);
 static void initCom();
 static void redraw();
 static void updateTitle();
+static void reportMemory();
+static void appendFailure(StringBuilder& message, const StringView& fileName, const Failure& failure);
+static void writeTrace(const wchar_t* path);
 static LRESULT __stdcall windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, wchar_t* lpCmdLine, int nCmdShow) {
+    // With BOOKVIEW_TRACE set to a file path, timing spans are recorded and written there as
+    // a Chrome trace at exit.
+    wchar_t tracePath[MAX_PATH];
+    DWORD tracePathCount = GetEnvironmentVariableW(L"BOOKVIEW_TRACE", tracePath, _countof(tracePath));
+    enableTracing(tracePathCount > 0 && tracePathCount < _countof(tracePath));
+
     initCom();
     initWindow(hInstance);
 
@@ -45,6 +60,10 @@ int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, wchar_t* lp
         DispatchMessageW(&msg);
     }
 
+    reportMemory();
+    if (tracingEnabled) {
+        writeTrace(tracePath);
+    }
     return 0;
 }
 
@@ -100,16 +119,31 @@ static void initWindow(HINSTANCE hInstance) {
     DragAcceptFiles(hwnd, true);
 }
 
-static ID2D1Bitmap* createBitmap(const String& imageData, int clientWidth, int clientHeight) {
-    auto stream = SHCreateMemStream((BYTE*)imageData.chars, (UINT)imageData.count);
-    verify(stream);
+// Releases a COM object when the scope ends, also when a failed verify unwinds it.
+template<typename T>
+struct ComScope {
+    T* object = nullptr;
+
+    ComScope() = default;
+    ~ComScope() { if (object) object->Release(); }
+    ComScope(const ComScope&) = delete;
+    ComScope& operator=(const ComScope&) = delete;
+    T* operator->() const { return object; }
+};
 
-    IWICBitmapDecoder* decoder = nullptr;
-    HRESULT hr = wicFactory->CreateDecoderFromStream(stream, nullptr, WICDecodeMetadataCacheOnDemand, &decoder);
+static ID2D1Bitmap* createBitmap(const StringView& imageData, int clientWidth, int clientHeight) {
+    TraceSpan span("createBitmap");
+    MemoryPhaseScope phase(MemoryPhase::CreateBitmap);
+    ComScope<IStream> stream;
+    stream.object = SHCreateMemStream((BYTE*)imageData.chars, (UINT)imageData.count);
+    verify(stream.object);
+
+    ComScope<IWICBitmapDecoder> decoder;
+    HRESULT hr = wicFactory->CreateDecoderFromStream(stream.object, nullptr, WICDecodeMetadataCacheOnDemand, &decoder.object);
     verify(SUCCEEDED(hr));
 
-    IWICBitmapFrameDecode* frame = nullptr;
-    hr = decoder->GetFrame(0, &frame);
+    ComScope<IWICBitmapFrameDecode> frame;
+    hr = decoder->GetFrame(0, &frame.object);
     verify(SUCCEEDED(hr));
 
     UINT width = 0;
@@ -123,30 +157,24 @@ static ID2D1Bitmap* createBitmap(const String& imageData, int clientWidth, int c
     float normWidth = scale * width;
     float normHeight = scale * height;
 
-    IWICBitmapScaler* scaler = nullptr;
-    hr = wicFactory->CreateBitmapScaler(&scaler);
+    ComScope<IWICBitmapScaler> scaler;
+    hr = wicFactory->CreateBitmapScaler(&scaler.object);
     verify(SUCCEEDED(hr));
 
-    hr = scaler->Initialize(frame, (int)normWidth, (int)normHeight, WICBitmapInterpolationModeHighQualityCubic);
+    hr = scaler->Initialize(frame.object, (int)normWidth, (int)normHeight, WICBitmapInterpolationModeHighQualityCubic);
     verify(SUCCEEDED(hr));
 
-    IWICFormatConverter* converter = nullptr;
-    hr = wicFactory->CreateFormatConverter(&converter);
+    ComScope<IWICFormatConverter> converter;
+    hr = wicFactory->CreateFormatConverter(&converter.object);
     verify(SUCCEEDED(hr));
 
-    hr = converter->Initialize(scaler, GUID_WICPixelFormat32bppPRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
+    hr = converter->Initialize(scaler.object, GUID_WICPixelFormat32bppPRGBA, WICBitmapDitherTypeNone, nullptr, 0.0, WICBitmapPaletteTypeCustom);
     verify(SUCCEEDED(hr));
 
     ID2D1Bitmap* bitmap = nullptr;
-    hr = hwndRenderTarget->CreateBitmapFromWicBitmap(converter, &bitmap);
+    hr = hwndRenderTarget->CreateBitmapFromWicBitmap(converter.object, &bitmap);
     verify(SUCCEEDED(hr));
 
-    converter->Release();
-    scaler->Release();
-    frame->Release();
-    decoder->Release();
-    stream->Release();
-
     return bitmap;
 }
 
@@ -174,7 +202,31 @@ static D2D1_RECT_F centerImage(float width, float height) {
     return result;
 }
 
+// Reads and decodes the image for the client size. Failures are written to the debugger output.
+static bool loadImage(Image& image, int clientWidth, int clientHeight) {
+    Failure failure;
+    bool loaded = recoverFailures([&] {
+        ScratchScope scratch;
+        auto imageData = currentEPub->readFile(image.fileName, scratch.arena);
+        image.bitmap = createBitmap(imageData, clientWidth, clientHeight);
+    }, &failure);
+    if (!loaded) {
+        StringBuilder message;
+        appendFailure(message, image.fileName, failure);
+        OutputDebugStringA(message.chars);
+        return false;
+    }
+
+    D2D1_SIZE_F size = image.bitmap->GetSize();
+    image.width = size.width;
+    image.height = size.height;
+    image.clientWidth = clientWidth;
+    image.clientHeight = clientHeight;
+    return true;
+}
+
 static void paintWindow() {
+    TraceSpan span("paintWindow");
     HRESULT hr;
     auto R = hwndRenderTarget;
 
@@ -188,31 +240,45 @@ static void paintWindow() {
 
     if (currentImageIndex < currentImages.count) {
         auto& image = currentImages[currentImageIndex];
-        if (!image.bitmap || image.clientWidth != clientWidth || image.clientHeight != clientHeight) {
+        if (!image.failed && (!image.bitmap || image.clientWidth != clientWidth || image.clientHeight != clientHeight)) {
             if (image.bitmap) image.bitmap->Release();
-            {
-                auto imageData = currentEPub->readFile(image.fileName);
-                image.bitmap = createBitmap(imageData, clientWidth, clientHeight);
-                imageData.destroy();
-            }
-            D2D1_SIZE_F size = image.bitmap->GetSize();
-            image.width = size.width;
-            image.height = size.height;
-            image.clientWidth = clientWidth;
-            image.clientHeight = clientHeight;
+            image.bitmap = nullptr;
+            image.failed = !loadImage(image, clientWidth, clientHeight);
         }
 
-        auto rect = centerImage(image.width, image.height);
-        R->DrawBitmap(image.bitmap, rect); // @TODO: Use WIC to resize image to correct size for quality result.
+        if (image.bitmap) {
+            auto rect = centerImage(image.width, image.height);
+            R->DrawBitmap(image.bitmap, rect); // @TODO: Use WIC to resize image to correct size for quality result.
+        }
     }
 
     hr = R->EndDraw();
     verify(SUCCEEDED(hr));
 }
 
-static void loadEPub(const String& fileName) {
+static void loadEPub(const StringView& fileName) {
+    reportMemory();
+    resetMemoryPeak();
+
+    // A book that can't be opened leaves the current one open.
     auto content = new EPub();
-    content->parse(fileName);
+    Failure failure;
+    if (!recoverFailures([&] { content->parse(fileName); }, &failure)) {
+        StringBuilder message;
+        appendFailure(message, fileName, failure);
+        MessageBoxA(hwnd, message.chars, "Can't open the book", MB_ICONWARNING);
+        content->destroy();
+        delete content;
+        return;
+    }
+    if (content->diagnostics.count > 0) {
+        StringBuilder message;
+        for (const auto& diagnostic : content->diagnostics) {
+            message.append("Skipped ");
+            appendFailure(message, diagnostic.href, diagnostic.failure);
+        }
+        OutputDebugStringA(message.chars);
+    }
 
     Array<Image> images;
     for (const auto& imagePath : content->images) {
@@ -281,18 +347,49 @@ static void redraw() {
 }
 
 static void updateTitle() {
-    wchar_t buffer[1024];
-
     if (currentEPub) {
-        auto fileName = toUtf16(currentEPub->fileName, nullptr);
-        swprintf_s(buffer, L"Book Image Viewer - (%d/%d) - %s", currentImageIndex, currentImages.count, fileName);
-        delete[] fileName;
-        SetWindowTextW(hwnd, buffer);
+        StringBuilder title;
+        title.append("Book Image Viewer - (").append(currentImageIndex).append('/').append(currentImages.count);
+        title.append(") - ").append(currentEPub->fileName);
+
+        ScratchScope scratch;
+        SetWindowTextW(hwnd, toUtf16(title.view(), scratch.arena));
     } else {
         SetWindowTextW(hwnd, L"Book Image Viewer");
     }
 }
 
+// Writes allocation stats to the debugger output when a book is closed and at exit, with the
+// peak of heap memory while the book was open.
+static void reportMemory() {
+    auto stats = getMemoryStats();
+    StringBuilder report;
+    if (currentEPub) {
+        report.append("Memory of ").append(currentEPub->fileName);
+        report.appendFormat(": peak %lld bytes\n", (long long)stats.peakLiveBytes);
+    }
+    appendMemoryStats(report, stats);
+    OutputDebugStringA(report.chars);
+}
+
+// Problems of the book are described by their message, failed verifies also by where they are.
+static void appendFailure(StringBuilder& message, const StringView& fileName, const Failure& failure) {
+    message.append(fileName).appendFormat(": %s", failure.message);
+    if (failure.kind == FailureKind::Internal) {
+        message.appendFormat(" at %s(%d)", failure.file, failure.line);
+    }
+    message.append('\n');
+}
+
+static void writeTrace(const wchar_t* path) {
+    StringBuilder trace;
+    appendChromeTrace(trace);
+    FILE* file = nullptr;
+    verify(0 == _wfopen_s(&file, path, L"wb"));
+    verify(fwrite(trace.chars, 1, trace.count, file) == (size_t)trace.count);
+    fclose(file);
+}
+
 static LRESULT __stdcall windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
         case WM_CREATE: {
@@ -0,0 +1,249 @@
+#include "memory.hpp"
+#include "string.hpp"
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#ifndef _MSC_VER
+#include <malloc.h>
+#endif
+
+enum {
+    allocationsCounter,
+    freesCounter,
+    allocatedBytesCounter,
+    freedBytesCounter,
+    arenaBlocksCounter,
+    arenaBytesCounter,
+    counterCount,
+};
+
+// Counters of one thread. Only the owning thread writes them, so adding is a plain load and
+// store instead of a locked instruction; readers may see them a few allocations behind.
+// They are never freed, threads that exited still count toward the totals. When their thread
+// exits they are handed to the next new thread, so threads that are started for every large
+// document don't add counters each.
+struct ThreadMemoryCounters {
+    std::atomic<int64_t> counters[(int)MemoryPhase::Count][counterCount];
+    ThreadMemoryCounters* next;
+    ThreadMemoryCounters* nextFree;
+};
+
+// Memory can be allocated before any constructor of this file ran, so everything here is
+// constant initialized.
+static std::atomic<ThreadMemoryCounters*> allThreadCounters;
+static ThreadMemoryCounters* freeThreadCounters;
+static std::atomic_flag registerLock = ATOMIC_FLAG_INIT;
+static std::atomic<int64_t> liveBytes;
+static std::atomic<int64_t> peakLiveBytes;
+static thread_local ThreadMemoryCounters* threadCounters = nullptr;
+static thread_local MemoryPhase currentPhase = MemoryPhase::Other;
+
+static void lockCounters() {
+    while (registerLock.test_and_set(std::memory_order_acquire)) {
+    }
+}
+
+static void unlockCounters() {
+    registerLock.clear(std::memory_order_release);
+}
+
+// Releases the counters of the thread when it exits. Kept apart from threadCounters, which
+// stays a plain pointer so counting an allocation doesn't check for thread_local construction.
+struct ThreadCountersRelease {
+    ~ThreadCountersRelease() {
+        if (threadCounters) {
+            lockCounters();
+            threadCounters->nextFree = freeThreadCounters;
+            freeThreadCounters = threadCounters;
+            unlockCounters();
+            threadCounters = nullptr;
+        }
+    }
+};
+
+static thread_local ThreadCountersRelease threadCountersRelease;
+
+MemoryPhaseScope::MemoryPhaseScope(MemoryPhase phase) : previous(currentPhase) {
+    currentPhase = phase;
+}
+
+MemoryPhaseScope::~MemoryPhaseScope() {
+    currentPhase = previous;
+}
+
+static ThreadMemoryCounters* acquireCounters() {
+    lockCounters();
+    auto counters = freeThreadCounters;
+    if (counters) {
+        freeThreadCounters = counters->nextFree;
+        unlockCounters();
+        return counters;
+    }
+    unlockCounters();
+
+    void* memory = malloc(sizeof(ThreadMemoryCounters));
+    verify(memory);
+    counters = new (memory) ThreadMemoryCounters();
+    lockCounters();
+    counters->next = allThreadCounters.load(std::memory_order_relaxed);
+    allThreadCounters.store(counters, std::memory_order_release);
+    unlockCounters();
+    return counters;
+}
+
+static std::atomic<int64_t>* phaseCounters() {
+    if (!threadCounters) {
+        threadCounters = acquireCounters();
+        // Constructs the release on first use, which registers its destructor for the thread.
+        (void)&threadCountersRelease;
+    }
+    return threadCounters->counters[(int)currentPhase];
+}
+
+static void add(std::atomic<int64_t>& counter, int64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Sizes are asked from the heap instead of being stored in a header, so tracked memory can
+// be freed by code that doesn't know about tracking and the other way around.
+static size_t allocationSize(void* memory) {
+#ifdef _MSC_VER
+    return _msize(memory);
+#else
+    return malloc_usable_size(memory);
+#endif
+}
+
+static void countAllocation(size_t size) {
+    auto counters = phaseCounters();
+    add(counters[allocationsCounter], 1);
+    add(counters[allocatedBytesCounter], (int64_t)size);
+    int64_t live = liveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+    int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+static void countFree(size_t size) {
+    auto counters = phaseCounters();
+    add(counters[freesCounter], 1);
+    add(counters[freedBytesCounter], (int64_t)size);
+    liveBytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+}
+
+void* memoryAllocate(size_t size) {
+    void* memory = malloc(size);
+    if (memory) {
+        countAllocation(allocationSize(memory));
+    }
+    return memory;
+}
+
+void* memoryReallocate(void* memory, size_t size) {
+    if (!memory) {
+        return memoryAllocate(size);
+    }
+    size_t oldSize = allocationSize(memory);
+    void* newMemory = realloc(memory, size);
+    if (newMemory) {
+        countFree(oldSize);
+        countAllocation(allocationSize(newMemory));
+    }
+    return newMemory;
+}
+
+void memoryFree(void* memory) {
+    if (memory) {
+        countFree(allocationSize(memory));
+        free(memory);
+    }
+}
+
+void countArenaBlock(size_t size) {
+    auto counters = phaseCounters();
+    add(counters[arenaBlocksCounter], 1);
+    add(counters[arenaBytesCounter], (int64_t)size);
+}
+
+MemoryStats getMemoryStats() {
+    MemoryStats result = {};
+    auto threads = allThreadCounters.load(std::memory_order_acquire);
+    for (auto thread = threads; thread; thread = thread->next) {
+        for (int i = 0; i < (int)MemoryPhase::Count; ++i) {
+            auto from = thread->counters[i];
+            auto& to = result.phases[i];
+            to.allocations += from[allocationsCounter].load(std::memory_order_relaxed);
+            to.frees += from[freesCounter].load(std::memory_order_relaxed);
+            to.allocatedBytes += from[allocatedBytesCounter].load(std::memory_order_relaxed);
+            to.freedBytes += from[freedBytesCounter].load(std::memory_order_relaxed);
+            to.arenaBlocks += from[arenaBlocksCounter].load(std::memory_order_relaxed);
+            to.arenaBytes += from[arenaBytesCounter].load(std::memory_order_relaxed);
+        }
+    }
+    result.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    result.peakLiveBytes = peakLiveBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void resetMemoryPeak() {
+    peakLiveBytes.store(liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+const char* memoryPhaseName(MemoryPhase phase) {
+    switch (phase) {
+        case MemoryPhase::Other: return "other";
+        case MemoryPhase::OpenBook: return "open book";
+        case MemoryPhase::ParseXml: return "parse xml";
+        case MemoryPhase::ReadFile: return "read file";
+        case MemoryPhase::CreateBitmap: return "create bitmap";
+        default: return "?";
+    }
+}
+
+void appendMemoryStats(StringBuilder& report, const MemoryStats& stats) {
+    report.appendFormat("%-14s %12s %12s %14s %14s %12s %14s\n", "phase", "allocations", "frees", "allocated", "freed", "arena blocks", "arena bytes");
+    for (int i = 0; i < (int)MemoryPhase::Count; ++i) {
+        const auto& phase = stats.phases[i];
+        report.appendFormat("%-14s %12lld %12lld %14lld %14lld %12lld %14lld\n", memoryPhaseName((MemoryPhase)i),
+            (long long)phase.allocations, (long long)phase.frees, (long long)phase.allocatedBytes,
+            (long long)phase.freedBytes, (long long)phase.arenaBlocks, (long long)phase.arenaBytes);
+    }
+    report.appendFormat("live %lld bytes, peak %lld bytes\n", (long long)stats.liveBytes, (long long)stats.peakLiveBytes);
+}
+
+// Every new and delete of the program goes through the counters.
+void* operator new(size_t size) {
+    void* memory = memoryAllocate(size ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return memoryAllocate(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return memoryAllocate(size ? size : 1);
+}
+
+void operator delete(void* memory) noexcept {
+    memoryFree(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    memoryFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    memoryFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    memoryFree(memory);
+}
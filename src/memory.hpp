@@ -0,0 +1,57 @@
+#pragma once
+#include "common.hpp"
+#include <stddef.h>
+#include <stdint.h>
+
+struct StringBuilder;
+
+// Heap allocations made with new and delete, by Array and by miniz are counted under the
+// phase of the thread that makes them. Arenas count the blocks they take into use, including
+// blocks reused from their spare list, which never reach the heap.
+enum class MemoryPhase {
+    Other,
+    OpenBook,
+    ParseXml,
+    ReadFile,
+    CreateBitmap,
+    Count,
+};
+
+struct MemoryPhaseStats {
+    int64_t allocations;
+    int64_t frees;
+    int64_t allocatedBytes;
+    int64_t freedBytes;
+    int64_t arenaBlocks;
+    int64_t arenaBytes;
+};
+
+struct MemoryStats {
+    MemoryPhaseStats phases[(int)MemoryPhase::Count];
+    // Heap bytes in use, and the most in use at once since resetMemoryPeak().
+    int64_t liveBytes;
+    int64_t peakLiveBytes;
+};
+
+// Counts allocations of the calling thread under phase until the scope is left. Scopes nest,
+// the innermost phase wins.
+struct MemoryPhaseScope {
+    MemoryPhase previous;
+
+    explicit MemoryPhaseScope(MemoryPhase phase);
+    ~MemoryPhaseScope();
+    MemoryPhaseScope(const MemoryPhaseScope&) = delete;
+    MemoryPhaseScope& operator=(const MemoryPhaseScope&) = delete;
+};
+
+void* memoryAllocate(size_t size);
+void* memoryReallocate(void* memory, size_t size);
+void memoryFree(void* memory);
+void countArenaBlock(size_t size);
+
+MemoryStats getMemoryStats();
+// Starts a new high-water mark at the bytes in use now, like when a book is opened.
+void resetMemoryPeak();
+const char* memoryPhaseName(MemoryPhase phase);
+// Appends a table of the stats, one line per phase.
+void appendMemoryStats(StringBuilder& report, const MemoryStats& stats);
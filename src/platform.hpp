@@ -0,0 +1,11 @@
+#pragma once
+#include "common.hpp"
+#include <stdio.h>
+
+// Operating system services the core library needs. They are implemented once per system, in
+// platform_win32.cpp and platform_posix.cpp, and everything else builds unchanged on both.
+
+// Opens a file by its UTF-8 path. Returns nullptr when it can't be opened.
+FILE* openFile(const StringView& path, const char* mode);
+// Shows the message of a failed verify, the process exits afterwards.
+void reportFailure(const char* message);
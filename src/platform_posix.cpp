@@ -0,0 +1,15 @@
+#include "platform.hpp"
+#include "arena.hpp"
+
+FILE* openFile(const StringView& path, const char* mode) {
+    // Paths are passed to the system as they are, it needs them null-terminated.
+    ScratchScope scratch;
+    auto terminated = scratch.arena->allocateString(path.count + 1);
+    memcpy(terminated.chars, path.chars, path.count);
+    terminated.chars[path.count] = '\0';
+    return fopen(terminated.chars, mode);
+}
+
+void reportFailure(const char* message) {
+    fprintf(stderr, "%s\n", message);
+}
@@ -0,0 +1,31 @@
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include "platform.hpp"
+#include "arena.hpp"
+#include "string.hpp"
+
+FILE* openFile(const StringView& path, const char* mode) {
+    // Modes are ASCII, like "rb".
+    wchar_t wideMode[8];
+    int i = 0;
+    for (; mode[i] && i < (int)_countof(wideMode) - 1; ++i) {
+        wideMode[i] = (wchar_t)mode[i];
+    }
+    wideMode[i] = L'\0';
+
+    ScratchScope scratch;
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, toUtf16(path, scratch.arena), wideMode) != 0) {
+        return nullptr;
+    }
+    return file;
+}
+
+void reportFailure(const char* message) {
+    // Console programs like the benchmarks print it, the viewer shows it over its window.
+    fprintf(stderr, "%s\n", message);
+    if (!GetConsoleWindow()) {
+        MessageBoxA(GetActiveWindow(), message, "Assertion failed", MB_ICONERROR);
+    }
+}
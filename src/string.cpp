@@ -1,86 +1,349 @@
 #include "string.hpp"
+#include "utf.hpp"
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
 #include <inttypes.h>
 
-String toUtf8(const wchar_t* src, size_t src_length) {
-    if (!src) return {};
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define STRING_SSE2
+#include <emmintrin.h>
+#endif
 
-    int bytes_required = WideCharToMultiByte(CP_UTF8, 0, src, (int)src_length, nullptr, 0, nullptr, nullptr);
-    verify(bytes_required > 0);
+OwnedString::OwnedString(const StringView& str) {
+    *this = allocate(str.count);
+    if (str.count > 0) {
+        memcpy(chars(), str.chars, str.count);
+    }
+}
 
-    char* dst = new char[bytes_required + 1];
+OwnedString::OwnedString(OwnedString&& other) {
+    *this = static_cast<OwnedString&&>(other);
+}
 
-    int chars_written = WideCharToMultiByte(CP_UTF8, 0, src, (int)src_length, dst, bytes_required, nullptr, nullptr);
-    verify(chars_written > 0);
-    verify(chars_written <= bytes_required);
+OwnedString& OwnedString::operator=(OwnedString&& other) {
+    if (this != &other) {
+        destroy();
+        // Inline chars are copied along, heap chars change owner.
+        memcpy((void*)this, (const void*)&other, sizeof(OwnedString));
+        other.length = 0;
+        other.small[0] = '\0';
+    }
+    return *this;
+}
 
-    dst[chars_written] = '\0';
-    return { dst, chars_written };
+OwnedString OwnedString::allocate(int count) {
+    verify(count >= 0);
+    OwnedString result;
+    result.length = count;
+    if (count > smallCapacity) {
+        result.heap = new char[count + 1];
+    }
+    result.chars()[count] = '\0';
+    return result;
 }
 
-wchar_t* toUtf16(const String& src, int* dst_length) {
-    if (!src.chars) return nullptr;
+void OwnedString::destroy() {
+    if (length > smallCapacity) {
+        delete[] heap;
+    }
+    length = 0;
+    small[0] = '\0';
+}
 
-    int chars_required = MultiByteToWideChar(CP_UTF8, 0, src.chars, (int)src.count, nullptr, 0);
-    verify(chars_required >= 0);
+#ifdef _WIN32
+static_assert(sizeof(wchar_t) == sizeof(uint16_t), "wchar_t must hold UTF-16 code units");
 
-    wchar_t* dst = new wchar_t[chars_required + 1];
+// Result is kept, so it is allocated with the exact size.
+OwnedString toUtf8(const wchar_t* src, size_t src_length) {
+    if (!src) return {};
+    verify(src_length <= INT_MAX / 3);
+
+    auto units = (const uint16_t*)src;
+    int count = (int)src_length;
+    int bytes_required = utf16ToUtf8Size(units, count);
+    if (bytes_required >= 0) {
+        auto result = OwnedString::allocate(bytes_required);
+        verify(utf16ToUtf8(units, count, result.chars()) == bytes_required);
+        return result;
+    }
+
+    // Unpaired surrogates, which file names may have, become U+FFFD like they did
+    // with WideCharToMultiByte.
+    auto dst = new char[utf16ToUtf8MaxSize(count)];
+    bytes_required = utf16BytesToUtf8((const char*)units, count, false, dst);
+    OwnedString result({ dst, bytes_required });
+    delete[] dst;
+    return result;
+}
+
+// Result is usually passed to a Windows function and dropped right away, so it is converted
+// in a single pass into a buffer of the maximum size.
+wchar_t* toUtf16(const StringView& src, Arena* arena) {
+    if (!src.chars) return nullptr;
 
-    int chars_written = MultiByteToWideChar(CP_UTF8, 0, src.chars, (int)src.count, dst, chars_required);
+    auto dst = (wchar_t*)arena->allocate((utf8ToUtf16MaxSize(src.count) + 1) * sizeof(wchar_t), alignof(wchar_t));
+    int chars_written = utf8ToUtf16(src.chars, src.count, (uint16_t*)dst);
     verify(chars_written >= 0);
-    verify(chars_written <= chars_required);
 
     dst[chars_written] = L'\0';
-
-    if (dst_length) *dst_length = chars_written;
     return dst;
 }
+#endif
+
+StringBuilder& StringBuilder::append(const StringView& str) {
+    reserve(count + str.count);
+    if (str.count > 0) {
+        memcpy(chars + count, str.chars, str.count);
+    }
+    count += str.count;
+    chars[count] = '\0';
+    return *this;
+}
+
+StringBuilder& StringBuilder::append(char c) {
+    reserve(count + 1);
+    chars[count++] = c;
+    chars[count] = '\0';
+    return *this;
+}
 
-String mprintf(const char* format, ...) {
+StringBuilder& StringBuilder::append(int64_t value) {
+    if (value < 0) {
+        append('-');
+        // Negated as unsigned, so INT64_MIN doesn't overflow.
+        return append(0 - (uint64_t)value);
+    }
+    return append((uint64_t)value);
+}
+
+StringBuilder& StringBuilder::append(uint64_t value) {
+    char digits[20];
+    int digitCount = 0;
+    do {
+        digits[sizeof(digits) - ++digitCount] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return append(StringView{ digits + sizeof(digits) - digitCount, digitCount });
+}
+
+StringBuilder& StringBuilder::appendFormat(const char* format, ...) {
     va_list args;
     va_start(args, format);
-    auto result = mprintf_valist(format, args);
+    appendFormatList(format, args);
     va_end(args);
-    return result;
+    return *this;
 }
 
-String mprintf_valist(const char* format, va_list args) {
-    int count = _vscprintf(format, args);
-    verify(count >= 0);
+StringBuilder& StringBuilder::appendFormatList(const char* format, va_list args) {
+    // A va_list can only be consumed once, the copy is for formatting again.
+    va_list retryArgs;
+    va_copy(retryArgs, args);
+    int available = capacity - count;
+    int formatted = vsnprintf(chars + count, available, format, args);
+    verify(formatted >= 0);
+    if (formatted >= available) {
+        reserve(count + formatted);
+        verify(vsnprintf(chars + count, formatted + 1, format, retryArgs) == formatted);
+    }
+    va_end(retryArgs);
+    count += formatted;
+    return *this;
+}
+
+void StringBuilder::reserve(int newCount) {
+    verify(newCount >= 0 && newCount < INT_MAX);
+    if (newCount < capacity) {
+        return;
+    }
+    int newCapacity = capacity * 2;
+    if (newCapacity <= newCount) {
+        newCapacity = newCount + 1;
+    }
+    auto newChars = new char[newCapacity];
+    memcpy(newChars, chars, count + 1);
+    if (chars != inlineChars) {
+        delete[] chars;
+    }
+    chars = newChars;
+    capacity = newCapacity;
+}
+
+StringView StringBuilder::toString(Arena* arena) const {
+    return copyString(view(), arena);
+}
+
+void StringBuilder::clear() {
+    count = 0;
+    chars[0] = '\0';
+}
 
-    auto result = new char[count + 1];
-    int realCount = vsnprintf(result, count + 1, format, args);
-    verify(realCount >= 0);
-    return String{ result, realCount };
+void StringBuilder::destroy() {
+    if (chars != inlineChars) {
+        delete[] chars;
+    }
+    chars = inlineChars;
+    capacity = inlineCapacity;
+    clear();
 }
 
-String copyString(const String& str) {
+StringView copyString(const StringView& str, Arena* arena) {
     if (str.isEmpty()) return {};
-    auto chars = new char[str.count];
-    memcpy(chars, str.chars, str.count);
-    return { chars, str.count };
+    auto result = arena->allocateString(str.count);
+    memcpy(result.chars, str.chars, str.count);
+    return result;
+}
+
+static int hexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
 }
 
-char* toCString(const String& str) {
-    auto result = new char[str.count + 1];
-    memcpy(result, str.chars, str.count);
-    result[str.count] = '\0';
+// Appends a segment to the path in buffer[0, count) and returns the new count. The path has
+// no trailing '/'. "." and ".." are recognized before decoding, so "%2E" isn't a dot. Like in
+// URLs, ".." at the root stays at the root, books do link above it.
+static inline int appendPathSegment(char* buffer, int count, const char* segment, int segmentCount, bool escaped) {
+    if (segmentCount == 0 || (segmentCount == 1 && segment[0] == '.')) {
+        return count;
+    }
+    if (segmentCount == 2 && segment[0] == '.' && segment[1] == '.') {
+        while (count > 0 && buffer[count - 1] != '/') {
+            --count;
+        }
+        return count > 0 ? count - 1 : 0;
+    }
+
+    if (count > 0) {
+        buffer[count++] = '/';
+    }
+    if (!escaped) {
+        memcpy(buffer + count, segment, segmentCount);
+        return count + segmentCount;
+    }
+    for (int i = 0; i < segmentCount; ++i) {
+        char c = segment[i];
+        if (c == '%' && i + 2 < segmentCount && hexDigitValue(segment[i + 1]) >= 0 && hexDigitValue(segment[i + 2]) >= 0) {
+            c = (char)(hexDigitValue(segment[i + 1]) * 16 + hexDigitValue(segment[i + 2]));
+            i += 2;
+        }
+        buffer[count++] = c;
+    }
+    return count;
+}
+
+// Segments are short, so they are scanned inline rather than with memchr.
+static int appendPathSegments(char* buffer, int count, const char* path, int pathCount, bool decode) {
+    int start = 0;
+    bool escaped = false;
+    for (int i = 0; i < pathCount; ++i) {
+        char c = path[i];
+        if (c == '/') {
+            count = appendPathSegment(buffer, count, path + start, i - start, escaped);
+            start = i + 1;
+            escaped = false;
+        } else if (c == '%') {
+            escaped = decode;
+        }
+    }
+    return appendPathSegment(buffer, count, path + start, pathCount - start, escaped);
+}
+
+int resolveRelativePath(const StringView& directory, const StringView& target, char* buffer) {
+    int targetCount = 0;
+    while (targetCount < target.count && target[targetCount] != '?' && target[targetCount] != '#') {
+        ++targetCount;
+    }
+    if (targetCount == 0) {
+        return 0;
+    }
+
+    int count = 0;
+    if (target[0] != '/') {
+        count = appendPathSegments(buffer, count, directory.chars, directory.count, false);
+    }
+    return appendPathSegments(buffer, count, target.chars, targetCount, true);
+}
+
+StringView resolveRelativePath(const StringView& directory, const StringView& target, Arena* arena) {
+    auto result = arena->allocateString(directory.count + 1 + target.count);
+    result.count = resolveRelativePath(directory, target, result.chars);
     return result;
 }
 
-bool stringEqualsCaseInsensitive(const String& a, const String& b) {
+static inline uint64_t loadWord(const char* chars) {
+    uint64_t word;
+    memcpy(&word, chars, sizeof(word));
+    return word;
+}
+
+// Packs 1 to 7 bytes into a word without reading past them. Byte order depends on count, so
+// only words of equal counts are comparable.
+static inline uint64_t loadPartialWord(const char* chars, int count) {
+    if (count >= 4) {
+        uint32_t low, high;
+        memcpy(&low, chars, sizeof(low));
+        memcpy(&high, chars + count - 4, sizeof(high));
+        return low | (uint64_t)high << 32;
+    }
+    return (uint64_t)(uint8_t)chars[0]
+        | (uint64_t)(uint8_t)chars[count >> 1] << 8
+        | (uint64_t)(uint8_t)chars[count - 1] << 16;
+}
+
+// Adds 0x20 to bytes that are 'A'..'Z', 8 bytes at a time. Bytes >= 0x80 are left as is.
+static inline uint64_t foldAsciiCase(uint64_t word) {
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highBits = 0x8080808080808080ull;
+    uint64_t lowBits = word & ~highBits;
+    uint64_t aboveZ = lowBits + ones * (0x7F - 'Z');
+    uint64_t atLeastA = lowBits + ones * (0x80 - 'A');
+    uint64_t upper = (atLeastA ^ aboveZ) & ~word & highBits;
+    return word | (upper >> 2);
+}
+
+bool stringEqualsCaseInsensitive(const StringView& a, const StringView& b) {
     return stringEqualsCaseInsensitive(a.chars, a.count, b.chars, b.count);
 }
 
 bool stringEqualsCaseInsensitive(const char* a, size_t a_length, const char* b, size_t b_length) {
     if (a_length != b_length) return false;
     if (a == b) return true;
-    return _strnicmp(a, b, a_length) == 0;
+
+    // Only ASCII letters are folded, like _strnicmp in the "C" locale, and the same way as
+    // hashStringCaseInsensitive does.
+    size_t i = 0;
+#ifdef STRING_SSE2
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= a_length; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        // Bytes >= 0x80 are negative as signed chars, so they are never letters.
+        __m128i xUpper = _mm_and_si128(_mm_cmpgt_epi8(x, beforeA), _mm_cmplt_epi8(x, afterZ));
+        __m128i yUpper = _mm_and_si128(_mm_cmpgt_epi8(y, beforeA), _mm_cmplt_epi8(y, afterZ));
+        x = _mm_or_si128(x, _mm_and_si128(xUpper, caseBit));
+        y = _mm_or_si128(y, _mm_and_si128(yUpper, caseBit));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+            return false;
+        }
+    }
+#endif
+    for (; i + 8 <= a_length; i += 8) {
+        if (foldAsciiCase(loadWord(a + i)) != foldAsciiCase(loadWord(b + i))) {
+            return false;
+        }
+    }
+    if (i < a_length) {
+        int rest = (int)(a_length - i);
+        return foldAsciiCase(loadPartialWord(a + i, rest)) == foldAsciiCase(loadPartialWord(b + i, rest));
+    }
+    return true;
 }
 
-bool stringEquals(const String& a, const String& b) {
+bool stringEquals(const StringView& a, const StringView& b) {
     return stringEquals(a.chars, a.count, b.chars, b.count);
 }
 
@@ -90,7 +353,44 @@ bool stringEquals(const char* a, size_t a_length, const char* b, size_t b_length
     return strncmp(a, b, a_length) == 0;
 }
 
-bool tryParseInt(const String& value, int* outResult) {
+static const uint64_t hashMultiplier = 0x9E3779B97F4A7C15ull;
+
+static inline uint64_t mixWord(uint64_t hash, uint64_t word) {
+    hash ^= word;
+    hash *= hashMultiplier;
+    return hash ^ (hash >> 29);
+}
+
+static inline uint64_t finishHash(uint64_t hash) {
+    hash ^= hash >> 32;
+    hash *= 0xD6E8FEB86659FD93ull;
+    return hash ^ (hash >> 32);
+}
+
+template<bool FoldCase>
+static inline uint64_t hashChars(const char* chars, int count) {
+    uint64_t hash = (uint64_t)count * hashMultiplier;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint64_t word = loadWord(chars + i);
+        hash = mixWord(hash, FoldCase ? foldAsciiCase(word) : word);
+    }
+    if (i < count) {
+        uint64_t word = loadPartialWord(chars + i, count - i);
+        hash = mixWord(hash, FoldCase ? foldAsciiCase(word) : word);
+    }
+    return finishHash(hash);
+}
+
+uint64_t hashString(const StringView& str) {
+    return hashChars<false>(str.chars, str.count);
+}
+
+uint64_t hashStringCaseInsensitive(const StringView& str) {
+    return hashChars<true>(str.chars, str.count);
+}
+
+bool tryParseInt(const StringView& value, int* outResult) {
     if (value.count > 10 || value.isEmpty()) {
         return false;
     }
@@ -129,13 +429,13 @@ bool tryParseInt(const String& value, int* outResult) {
     return true;
 }
 
-int parseInt(const String& value) {
+int parseInt(const StringView& value) {
     int result;
     verify(tryParseInt(value, &result));
     return result;
 }
 
-bool parseBoolean(const String& value) {
+bool parseBoolean(const StringView& value) {
     if (stringEqualsCaseInsensitive(value, "True")) {
         return true;
     } else if (stringEqualsCaseInsensitive(value, "False")) {
@@ -145,13 +445,13 @@ bool parseBoolean(const String& value) {
     return false;
 }
 
-String substring(const String& str, int start, int count) {
+StringView substring(const StringView& str, int start, int count) {
     verify(start >= 0);
     verify(count >= 0 && count <= str.count);
     return { str.chars + start, count };
 }
 
-int indexOf(const String& str, char c) {
+int indexOf(const StringView& str, char c) {
     for (int i = 0; i < str.count; ++i) {
         if (str.chars[i] == c) {
             return i;
@@ -160,7 +460,7 @@ int indexOf(const String& str, char c) {
     return -1;
 }
 
-int lastIndexOf(const String& str, char c) {
+int lastIndexOf(const StringView& str, char c) {
     for (int i = str.count - 1; i >= 0; --i) {
         if (str.chars[i] == c) {
             return i;
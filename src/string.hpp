@@ -1,24 +1,111 @@
 #pragma once
 #include "common.hpp"
+#include "arena.hpp"
 #include <stdarg.h>
+#include <stdint.h>
 
-String toUtf8(const wchar_t* src, size_t src_length);
-wchar_t* toUtf16(const String& src, int* dst_length);
-String copyString(const String& str);
-char* toCString(const String& str);
-bool stringEqualsCaseInsensitive(const String& a, const String& b);
+// Owning string, freed when it goes out of scope. Move-only, so a copy is never made by
+// accident; views of it are valid until it is changed, moved or destroyed. Strings of up to
+// smallCapacity chars are stored inline without a heap allocation. chars() is always null
+// terminated, so it can be passed to C functions.
+struct OwnedString {
+    static const int smallCapacity = 16;
+
+    OwnedString() { small[0] = '\0'; }
+    explicit OwnedString(const StringView& str);
+    OwnedString(OwnedString&& other);
+    OwnedString& operator=(OwnedString&& other);
+    OwnedString(const OwnedString&) = delete;
+    OwnedString& operator=(const OwnedString&) = delete;
+    ~OwnedString() { destroy(); }
+
+    // String of count uninitialized chars, to be filled through chars().
+    static OwnedString allocate(int count);
+
+    inline int count() const { return length; }
+    inline char* chars() { return length <= smallCapacity ? small : heap; }
+    inline const char* chars() const { return length <= smallCapacity ? small : heap; }
+    inline StringView view() const { return { (char*)chars(), length }; }
+    inline operator StringView() const { return view(); }
+    void destroy();
+private:
+    // Tells where the chars are, so it can't be changed without reallocating.
+    int length = 0;
+    union {
+        char* heap;
+        char small[smallCapacity + 1];
+    };
+};
+
+// Builds a string from pieces. Text goes into an inline buffer first, so short strings like
+// titles and keys are built on the stack; longer ones move to the heap. The result is always
+// null terminated and is valid until the builder is changed or destroyed; copy it out with
+// toOwnedString() or toString(arena) to keep it.
+struct StringBuilder {
+    static const int inlineCapacity = 256;
+
+    char* chars;
+    int count = 0;
+    int capacity = inlineCapacity;
+
+    StringBuilder() : chars(inlineChars) { inlineChars[0] = '\0'; }
+    StringBuilder(const StringBuilder&) = delete;
+    StringBuilder& operator=(const StringBuilder&) = delete;
+    ~StringBuilder() { destroy(); }
+
+    StringBuilder& append(const StringView& str);
+    StringBuilder& append(const char* str) { return append(wrapCString(str)); }
+    StringBuilder& append(char c);
+    StringBuilder& append(int value) { return append((int64_t)value); }
+    StringBuilder& append(int64_t value);
+    StringBuilder& append(uint64_t value);
+    // printf-style formatting straight into the buffer. Formats a second time only when the
+    // result didn't fit.
+    StringBuilder& appendFormat(const char* format, ...);
+    StringBuilder& appendFormatList(const char* format, va_list args);
+
+    // Makes room for newCount chars and the terminating null.
+    void reserve(int newCount);
+    inline StringView view() const { return { chars, count }; }
+    OwnedString toOwnedString() const { return OwnedString(view()); }
+    StringView toString(Arena* arena) const;
+    void clear();
+    void destroy();
+private:
+    char inlineChars[inlineCapacity];
+};
+
+#ifdef _WIN32
+// Conversions for Windows functions, where wchar_t strings are UTF-16.
+OwnedString toUtf8(const wchar_t* src, size_t src_length);
+// Null-terminated UTF-16 copy of src in arena, usually the scratch arena.
+wchar_t* toUtf16(const StringView& src, Arena* arena);
+#endif
+// Copies str into arena, for views that have to outlive the memory they point into.
+StringView copyString(const StringView& str, Arena* arena);
+bool stringEqualsCaseInsensitive(const StringView& a, const StringView& b);
 bool stringEqualsCaseInsensitive(const char* a, size_t a_length, const char* b, size_t b_length);
-bool stringEquals(const String& a, const String& b);
+bool stringEquals(const StringView& a, const StringView& b);
 bool stringEquals(const char* a, size_t a_length, const char* b, size_t b_length);
-inline bool operator==(const String& a, const String& b) { return stringEquals(a, b); }
-inline bool operator!=(const String& a, const String& b) { return !stringEquals(a, b); }
-inline bool operator==(const String& a, const char* b) { return stringEquals(a.chars, a.count, b, b ? strlen(b) : 0); }
-inline bool operator!=(const String& a, const char* b) { return !stringEquals(a.chars, a.count, b, b ? strlen(b) : 0); }
-String mprintf(const char* format, ...);
-String mprintf_valist(const char* format, va_list args);
-bool tryParseInt(const String& value, int* result);
-int parseInt(const String& value);
-bool parseBoolean(const String& value);
-String substring(const String& str, int start, int count);
-int indexOf(const String& str, char c);
-int lastIndexOf(const String& str, char c);
+inline bool operator==(const StringView& a, const StringView& b) { return stringEquals(a, b); }
+inline bool operator!=(const StringView& a, const StringView& b) { return !stringEquals(a, b); }
+inline bool operator==(const StringView& a, const char* b) { return stringEquals(a.chars, a.count, b, b ? strlen(b) : 0); }
+inline bool operator!=(const StringView& a, const char* b) { return !stringEquals(a.chars, a.count, b, b ? strlen(b) : 0); }
+bool tryParseInt(const StringView& value, int* result);
+int parseInt(const StringView& value);
+bool parseBoolean(const StringView& value);
+StringView substring(const StringView& str, int start, int count);
+int indexOf(const StringView& str, char c);
+int lastIndexOf(const StringView& str, char c);
+// Resolves the relative URL target against directory, a path without a trailing '/' like
+// "OEBPS/Text". "." and ".." segments are applied, ".." stops at the root. "?query" and
+// "#fragment" are dropped and "%XX" escapes of target are decoded. A leading '/' starts at the
+// root instead of directory.
+// Same-document references like "#note" resolve to an empty path. The result is written in
+// a single pass into buffer, which must hold directory.count + 1 + target.count chars.
+int resolveRelativePath(const StringView& directory, const StringView& target, char* buffer);
+StringView resolveRelativePath(const StringView& directory, const StringView& target, Arena* arena);
+// Fast non-cryptographic hashes, 8 bytes at a time. The case-insensitive variant folds ASCII
+// letters, so strings equal by stringEqualsCaseInsensitive hash the same.
+uint64_t hashString(const StringView& str);
+uint64_t hashStringCaseInsensitive(const StringView& str);
@@ -0,0 +1,32 @@
+#pragma once
+#include "../common.hpp"
+#include <stdarg.h>
+#include <stdio.h>
+
+// Checks of the test executables. A failed check is reported and the test continues, main
+// returns testResult() so ctest sees whether any check failed.
+
+static int testFailureCount = 0;
+
+static void testCheckImpl(bool passed, const char* file, int line, const char* format, ...) {
+    if (passed) {
+        return;
+    }
+    ++testFailureCount;
+    fprintf(stderr, "%s(%d): ", file, line);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+#define testCheck(cond, ...) testCheckImpl((cond), __FILE__, __LINE__, __VA_ARGS__)
+
+static int testResult() {
+    if (testFailureCount > 0) {
+        fprintf(stderr, "%d checks failed\n", testFailureCount);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "test.hpp"
+#include "../arena.hpp"
+
+static void testBlocksAreReused() {
+    Arena arena;
+    auto mark = arena.mark();
+    void* first = arena.allocate(100);
+    arena.reset(mark);
+    testCheck(arena.allocate(100) == first, "regular block is reused after reset");
+
+    arena.reset(mark);
+    void* large = arena.allocate(100 * 1024);
+    arena.reset(mark);
+    testCheck(arena.allocate(64 * 1024) == large, "large block is reused for a smaller large allocation");
+    arena.reset(mark);
+    arena.allocate(200 * 1024);
+    testCheck(arena.spareLargeCount == 0, "large spares that are too small are freed");
+    arena.destroy();
+}
+
+// One large document must not leave the arena holding all of its blocks.
+static void testSparesAreCapped() {
+    Arena arena;
+    auto mark = arena.mark();
+    for (int i = 0; i < 1000; ++i) {
+        arena.allocate(arena.blockSize / 2);
+        arena.allocate(arena.blockSize * 2);
+    }
+    arena.reset(mark);
+    testCheck(arena.spareCount == Arena::maxSpareBlocks, "%d regular spares kept", arena.spareCount);
+    testCheck(arena.spareLargeCount == Arena::maxSpareLargeBlocks, "%d large spares kept", arena.spareLargeCount);
+
+    // Taking a regular block doesn't depend on the number of spares, it is the head.
+    auto head = arena.spare;
+    testCheck((void*)arena.allocate(8) == (void*)(head + 1), "regular block is taken from the head");
+    testCheck(arena.spareCount == Arena::maxSpareBlocks - 1, "taken block leaves the spares");
+    arena.destroy();
+}
+
+int main() {
+    testBlocksAreReused();
+    testSparesAreCapped();
+    return testResult();
+}
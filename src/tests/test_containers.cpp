@@ -0,0 +1,214 @@
+#include "test.hpp"
+#include "../arena.hpp"
+#include "../array.hpp"
+#include "../hash.hpp"
+
+// Keys are their own hash, so a test picks the home slot of each key: key & (capacity - 1).
+struct IdentityHashTraits {
+    static uint64_t hash(int key) { return (uint64_t)key; }
+    static bool equals(int a, int b) { return a == b; }
+};
+
+typedef HashMap<int, int, IdentityHashTraits> IdentityMap;
+
+static int homedKey(int home, int n) {
+    return home + 16 * n;
+}
+
+static void testHashMapWraparound() {
+    IdentityMap map;
+    map.reserve(10);
+    testCheck(map.capacity == 16, "capacity %d", map.capacity);
+
+    // Three keys homed at slot 14 run past the end of the table into slots 15 and 0, the keys
+    // homed at 15 and 0 are displaced into slots 1 and 2.
+    int keys[]{ homedKey(14, 1), homedKey(14, 2), homedKey(14, 3), homedKey(15, 1), homedKey(0, 1) };
+    for (int key : keys) {
+        testCheck(map.insert(key, key * 10), "%d is inserted", key);
+    }
+    testCheck(!map.insert(keys[1], 7) && *map.find(keys[1]) == 7, "inserting again replaces the value");
+    map.insert(keys[1], keys[1] * 10);
+    testCheck(map.slots[0].key == keys[2] && map.slots[1].key == keys[3] && map.slots[2].key == keys[4], "probes wrap around");
+
+    // Removing the first key shifts every following entry back by one slot, across the end.
+    testCheck(map.remove(keys[0]), "first key is removed");
+    testCheck(map.slots[14].key == keys[1] && map.slots[15].key == keys[2], "entries homed at 14 shift back");
+    testCheck(map.slots[0].key == keys[3] && map.slots[1].key == keys[4] && map.slots[2].hash == 0, "entries homed past the end shift back");
+    for (int i = 1; i < 5; ++i) {
+        auto value = map.find(keys[i]);
+        testCheck(value && *value == keys[i] * 10, "%d is found after removal", keys[i]);
+    }
+    testCheck(!map.find(keys[0]) && !map.remove(keys[0]) && map.count == 4, "removed key is gone");
+
+    // An entry at its home slot stays put when a key before it is removed.
+    testCheck(map.remove(keys[3]), "key homed at 15 is removed");
+    testCheck(map.slots[0].key == keys[4] && map.slots[1].hash == 0, "key homed at 0 moves home");
+    testCheck(map.remove(keys[1]) && map.slots[14].key == keys[2] && map.slots[15].hash == 0, "last key homed at 14 moves home");
+    map.destroy();
+}
+
+// Random inserts and removals in a small table, checked against a plain array.
+static void testHashMapAgainstArray() {
+    const int keyRange = 64;
+    int expected[keyRange];
+    for (auto& value : expected) {
+        value = -1;
+    }
+
+    IdentityMap map;
+    uint32_t random = 12345;
+    for (int step = 0; step < 20000; ++step) {
+        random = random * 1103515245 + 12345;
+        int key = (int)((random >> 16) % keyRange);
+        if ((random >> 8) & 1) {
+            testCheck(map.insert(key, step) == (expected[key] == -1), "insert %d at step %d", key, step);
+            expected[key] = step;
+        } else {
+            testCheck(map.remove(key) == (expected[key] != -1), "remove %d at step %d", key, step);
+            expected[key] = -1;
+        }
+        if (step % 97 == 0) {
+            int count = 0;
+            for (int i = 0; i < keyRange; ++i) {
+                auto value = map.find(i);
+                testCheck(expected[i] == -1 ? !value : value && *value == expected[i], "find %d at step %d", i, step);
+                count += expected[i] != -1;
+            }
+            testCheck(map.count == count, "count at step %d", step);
+        }
+    }
+    map.destroy();
+}
+
+// Element that checks it is only moved by its constructors, never with memcpy.
+struct Tracked {
+    static int live;
+    int value;
+    const Tracked* self;
+
+    Tracked(int value) : value(value), self(this) { ++live; }
+    Tracked(const Tracked& other) : value(other.value), self(this) { check(other); ++live; }
+    Tracked(Tracked&& other) : value(other.value), self(this) { check(other); ++live; }
+    ~Tracked() { check(*this); --live; }
+    Tracked& operator=(const Tracked& other) { check(other); check(*this); value = other.value; return *this; }
+    bool operator==(const Tracked& other) const { return value == other.value; }
+
+    static void check(const Tracked& tracked) {
+        testCheck(tracked.self == &tracked, "element %d was relocated with memcpy", tracked.value);
+    }
+};
+
+int Tracked::live = 0;
+
+template<typename T>
+static bool hasValues(const Array<T>& array, const int* values, int count) {
+    if (array.count != count) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!(array[i] == T(values[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+static void testInsertAliasing(const char* name) {
+    Array<T> array;
+    for (int i = 0; i < 8; ++i) {
+        array.push(T(i));
+    }
+    testCheck(array.count == array.capacity, "%s: array is full", name);
+    // The source is inside the array, which moves when it grows.
+    array.insertMultipleAt(2, array.data + 5, 3);
+    const int inserted[]{ 0, 1, 5, 6, 7, 2, 3, 4, 5, 6, 7 };
+    testCheck(hasValues(array, inserted, _countof(inserted)), "%s: insert from the array itself", name);
+
+    // Inserting at the end constructs past the old count.
+    array.insertMultipleAt(array.count, array.data, 2);
+    array.insertAt(0, array.last());
+    const int appended[]{ 1, 0, 1, 5, 6, 7, 2, 3, 4, 5, 6, 7, 0, 1 };
+    testCheck(hasValues(array, appended, _countof(appended)), "%s: insert at the ends", name);
+
+    array.removeManyAt(1, 5);
+    array.removeAt(array.count - 1);
+    const int removed[]{ 1, 2, 3, 4, 5, 6, 7, 0 };
+    testCheck(hasValues(array, removed, _countof(removed)), "%s: remove", name);
+
+    array.reverse();
+    array.remove(T(4));
+    const int reversed[]{ 0, 7, 6, 5, 3, 2, 1 };
+    testCheck(hasValues(array, reversed, _countof(reversed)), "%s: reverse and remove", name);
+    array.destroy();
+}
+
+static void testArrayRelocation() {
+    Array<Tracked> array;
+    for (int i = 0; i < 100; ++i) {
+        array.push(Tracked(i));
+        // Pushing an element of the array itself while it grows.
+        if (array.count == array.capacity) {
+            array.push(array[0]);
+            array.pop();
+        }
+    }
+    array.reserve(1000);
+    bool intact = array.count == 100;
+    for (int i = 0; i < array.count; ++i) {
+        intact = intact && array[i].value == i && array[i].self == &array[i];
+    }
+    testCheck(intact, "elements survive relocation");
+    testCheck(Tracked::live == 100, "%d live elements", Tracked::live);
+    array.destroy();
+    testCheck(Tracked::live == 0, "%d elements left after destroy", Tracked::live);
+
+    testInsertAliasing<int>("int");
+    testInsertAliasing<Tracked>("non-trivial");
+    testCheck(Tracked::live == 0, "%d elements left after inserts", Tracked::live);
+}
+
+static void testSmallArraySpill() {
+    SmallArray<Tracked, 4> small;
+    auto inlineData = small.data;
+    for (int i = 0; i < 4; ++i) {
+        small.push(Tracked(i));
+    }
+    testCheck(small.data == inlineData && small.borrowedStorage, "4 elements fit inline");
+    small.push(Tracked(4));
+    const int spilled[]{ 0, 1, 2, 3, 4 };
+    testCheck(small.data != inlineData && !small.borrowedStorage && hasValues(small, spilled, 5), "fifth element moves to the heap");
+    small.destroy();
+    testCheck(small.data == inlineData && small.capacity == 4 && small.count == 0, "destroy returns to the inline buffer");
+    testCheck(Tracked::live == 0, "%d elements left after the heap", Tracked::live);
+
+    ScratchScope scratch;
+    small.push(Tracked(0));
+    small.push(Tracked(1));
+    small.reserve(8, scratch.arena);
+    testCheck(small.data != inlineData && small.borrowedStorage && small.capacity == 8, "reserve moves to the arena");
+    for (int i = 2; i < 8; ++i) {
+        small.push(Tracked(i));
+    }
+    const int inArena[]{ 0, 1, 2, 3, 4, 5, 6, 7 };
+    testCheck(small.borrowedStorage && hasValues(small, inArena, 8), "arena storage is used until full");
+    small.push(Tracked(8));
+    testCheck(!small.borrowedStorage && small.count == 9 && small[8].value == 8, "growing past the arena storage moves to the heap");
+    small.destroy();
+    testCheck(Tracked::live == 0, "%d elements left after the arena", Tracked::live);
+
+    SmallArray<int, 2> ints;
+    ints.push(1);
+    ints.reserve(4, scratch.arena);
+    ints.push(2);
+    testCheck(ints.borrowedStorage && ints.count == 2 && ints[0] == 1 && ints[1] == 2, "trivial elements move to the arena");
+    ints.destroy();
+}
+
+int main() {
+    testHashMapWraparound();
+    testHashMapAgainstArray();
+    testArrayRelocation();
+    testSmallArraySpill();
+    return testResult();
+}
@@ -0,0 +1,166 @@
+#include "test.hpp"
+#include "../arena.hpp"
+#include "../epub.hpp"
+#include "../miniz.h"
+#include "../string.hpp"
+#include "../xml.hpp"
+#include <stdio.h>
+
+// Malformed pages and books must fail through recoverFailures without leaking what the parser
+// had built so far. Build with BOOKVIEW_SANITIZE to have leaks and overflows reported.
+
+static bool parseFails(const StringView& source, const XmlParseOptions& options) {
+    Failure failure;
+    return !recoverFailures([&] { parseXml(source, options); }, &failure) && failure.kind == FailureKind::MalformedXml;
+}
+
+static FailureKind openFailure(EPub& book, const char* path) {
+    Failure failure;
+    if (recoverFailures([&] { book.parse(wrapCString(path)); }, &failure)) {
+        return (FailureKind)-1;
+    }
+    return failure.kind;
+}
+
+static void testMalformedPage(const StringView& source, const char* name) {
+    XmlParseOptions options;
+    testCheck(parseFails(source, options), "%s fails without an arena", name);
+
+    ScratchScope scratch;
+    options.arena = scratch.arena;
+    testCheck(parseFails(source, options), "%s fails in the scratch arena", name);
+}
+
+// Malformed in ways that leave the tree builder's arrays past their inline storage.
+static void testMalformedPages() {
+    StringBuilder page;
+    page.append("<html><body>");
+    for (int i = 0; i < 400; ++i) {
+        page.append("<p>unclosed sibling");
+    }
+    page.append("</body></html>");
+    testMalformedPage(page.view(), "unclosed siblings");
+
+    page.clear();
+    page.append("<html><body>");
+    for (int i = 0; i < 100; ++i) {
+        page.append("<div><p>text</p>");
+    }
+    page.append("</body></html>");
+    testMalformedPage(page.view(), "unclosed nesting");
+
+    page.clear();
+    page.append("<html xmlns='http://www.w3.org/1999/xhtml'><body>");
+    for (int i = 0; i < 20; ++i) {
+        page.appendFormat("<svg xmlns:n%d='urn:namespace:%d'>", i, i);
+    }
+    page.append("<p>mismatched</div></body></html>");
+    testMalformedPage(page.view(), "many namespaces");
+
+    testMalformedPage("<html><body><p class=\"unterminated></p></body></html>", "unterminated attribute");
+    testMalformedPage("<html><body><p>text</p></body></html><trailing/>", "second root");
+    // "<a/>" in UTF-16 with a stray byte after it.
+    testMalformedPage("\xFF\xFE<\0a\0/\0>\0x", "odd-sized UTF-16");
+}
+
+// Large enough to be tokenized in chunks on multiple threads, broken at the end so the
+// failure comes from building the tree.
+static void testMalformedParallelPage() {
+    StringBuilder page;
+    page.append("<html><body>");
+    while (page.count < 3 * 1024 * 1024) {
+        page.append("<div class=\"c\"><p>paragraph of text</p></div>\n");
+    }
+    page.append("<p></div></body></html>");
+
+    XmlParseOptions options;
+    options.parallelMinSize = 1024 * 1024;
+    testCheck(parseFails(page.view(), options), "large page fails");
+}
+
+static void addEntry(mz_zip_archive* zip, const char* name, const char* data) {
+    testCheck(mz_zip_writer_add_mem(zip, name, data, strlen(data), MZ_DEFAULT_LEVEL) != 0, "can't add %s", name);
+}
+
+static void writeBook(const char* path, const char* packageDocument, const char* page) {
+    mz_zip_archive zip;
+    mz_zip_zero_struct(&zip);
+    testCheck(mz_zip_writer_init_file(&zip, path, 0) != 0, "can't create %s", path);
+    addEntry(&zip, "mimetype", "application/epub+zip");
+    addEntry(&zip, "META-INF/container.xml",
+        "<container><rootfiles><rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/></rootfiles></container>");
+    addEntry(&zip, "OEBPS/content.opf", packageDocument);
+    addEntry(&zip, "OEBPS/page.xhtml", page);
+    mz_zip_writer_finalize_archive(&zip);
+    mz_zip_writer_end(&zip);
+}
+
+static const char validPackage[] =
+    "<package><manifest>"
+    "<item id=\"page\" href=\"page.xhtml\" media-type=\"application/xhtml+xml\"/>"
+    "<item id=\"missing\" href=\"missing.xhtml\" media-type=\"application/xhtml+xml\"/>"
+    "</manifest><spine><itemref idref=\"page\"/><itemref idref=\"missing\"/><itemref idref=\"unknown\"/></spine></package>";
+
+static void testMalformedBooks() {
+    const char* path = "test_failures.epub";
+
+    writeBook(path, validPackage, "<html><body><img src=\"a.png\"></body></html>");
+    EPub book;
+    testCheck(openFailure(book, path) == (FailureKind)-1, "book with a broken page opens");
+    testCheck(book.diagnostics.count == 3, "broken page, missing page and unknown idref are reported, got %d", book.diagnostics.count);
+    if (book.diagnostics.count == 3) {
+        // The manifest is checked before pages are parsed.
+        testCheck(book.diagnostics[0].failure.kind == FailureKind::MissingEntry, "unknown idref is a missing entry");
+        testCheck(book.diagnostics[1].failure.kind == FailureKind::MalformedXml, "broken page is malformed XML");
+        testCheck(book.diagnostics[2].failure.kind == FailureKind::MissingEntry, "missing page is a missing entry");
+    }
+    Failure failure;
+    testCheck(!recoverFailures([&] { book.readXmlFile("OEBPS/page.xhtml", {}); }, &failure), "broken page fails without an arena");
+    book.destroy();
+
+    // Links above the root of the book stay at the root, like in browsers.
+    writeBook(path, "<package><manifest><item id=\"page\" href=\"page.xhtml\"/></manifest><spine><itemref idref=\"page\"/></spine></package>",
+        "<html><body><img src=\"../../../a.png\"/><img src=\"b.png\"/></body></html>");
+    EPub aboveRoot;
+    testCheck(openFailure(aboveRoot, path) == (FailureKind)-1 && aboveRoot.diagnostics.count == 0, "link above the root doesn't fail the page");
+    testCheck(aboveRoot.images.count == 2 && aboveRoot.images[0] == "a.png" && aboveRoot.images[1] == "OEBPS/b.png", "images of the page are collected");
+    aboveRoot.destroy();
+
+    writeBook(path, "<package><manifest><item id=\"page\" href=\"page.xhtml\"/><item id=\"truncated", "<html/>");
+    EPub badPackage;
+    testCheck(openFailure(badPackage, path) == FailureKind::MalformedXml, "malformed package document fails as malformed XML");
+    badPackage.destroy();
+
+    // Package documents that are cut off between tags, or miss the spine, would open as empty books.
+    static const char* const incompletePackages[]{
+        "<package><manifest><item id=\"page\" href=\"page.xhtml\"/></manifest><spine><itemref idref=\"page\"/>",
+        "<package><manifest><item id=\"page\" href=\"page.xhtml\"/></spine></package>",
+        "<package><manifest><item id=\"page\" href=\"page.xhtml\"/></manifest></package>",
+        "<package><metadata/></package>",
+    };
+    for (auto package : incompletePackages) {
+        writeBook(path, package, "<html/>");
+        EPub incomplete;
+        testCheck(openFailure(incomplete, path) == FailureKind::MalformedXml, "incomplete package document fails as malformed XML: %s", package);
+        incomplete.destroy();
+    }
+
+    FILE* file = fopen(path, "wb");
+    fputs("not a zip", file);
+    fclose(file);
+    EPub notZip;
+    testCheck(openFailure(notZip, path) == FailureKind::NotZip, "file that isn't a zip fails as not a zip");
+    notZip.destroy();
+
+    remove(path);
+    EPub missing;
+    testCheck(openFailure(missing, path) == FailureKind::Io, "file that doesn't exist fails as I/O error");
+    missing.destroy();
+}
+
+int main() {
+    testMalformedPages();
+    testMalformedParallelPage();
+    testMalformedBooks();
+    return testResult();
+}
@@ -0,0 +1,101 @@
+#include "test.hpp"
+#include "../arena.hpp"
+#include "../string.hpp"
+#include <limits.h>
+#include <string.h>
+
+struct PathCase {
+    const char* directory;
+    const char* target;
+    const char* resolved;
+};
+
+static const PathCase pathCases[]{
+    { "OEBPS/Text", "a.png", "OEBPS/Text/a.png" },
+    { "OEBPS/Text", "./a.png", "OEBPS/Text/a.png" },
+    { "OEBPS/Text", "../Images/a.png", "OEBPS/Images/a.png" },
+    { "OEBPS/Text", "dir/./sub/../a.png", "OEBPS/Text/dir/a.png" },
+    { "OEBPS/Text", "a//b.png", "OEBPS/Text/a/b.png" },
+    { "OEBPS/Text", "../../a.png", "a.png" },
+    { "OEBPS/Text", "../../../../a.png", "a.png" },
+    { "OEBPS/Text", "/Images/a.png", "Images/a.png" },
+    { "OEBPS/Text", "/../a.png", "a.png" },
+    { "", "a.png", "a.png" },
+    { "", "../a.png", "a.png" },
+    // Queries and fragments are dropped, same-document references resolve to nothing.
+    { "OEBPS/Text", "a.png?size=1", "OEBPS/Text/a.png" },
+    { "OEBPS/Text", "a.png#frag", "OEBPS/Text/a.png" },
+    { "OEBPS/Text", "a.png?q#f", "OEBPS/Text/a.png" },
+    { "OEBPS/Text", "#note", "" },
+    { "OEBPS/Text", "?q", "" },
+    { "OEBPS/Text", "", "" },
+    // Escapes of the target are decoded, after dot segments are recognized.
+    { "OEBPS/Text", "a%20b.png", "OEBPS/Text/a b.png" },
+    { "OEBPS/Text", "%41%42.png", "OEBPS/Text/AB.png" },
+    { "OEBPS/Text", "%2e%2E/a.png", "OEBPS/Text/../a.png" },
+    { "OEBPS/Text", "a%zz.png", "OEBPS/Text/a%zz.png" },
+    { "OEBPS/Text", "a%4", "OEBPS/Text/a%4" },
+    { "OEBPS/Text", "a%", "OEBPS/Text/a%" },
+    { "OEBPS/A%20B", "x.png", "OEBPS/A%20B/x.png" },
+};
+
+static void testResolveRelativePath() {
+    ScratchScope scratch;
+    for (const auto& test : pathCases) {
+        auto resolved = resolveRelativePath(wrapCString(test.directory), wrapCString(test.target), scratch.arena);
+        testCheck(resolved == test.resolved, "\"%s\" in \"%s\" resolves to \"%.*s\"", test.target, test.directory,
+            resolved.count, resolved.chars);
+    }
+}
+
+static void testStringBuilderSpill() {
+    StringBuilder builder;
+    char expected[1024];
+    int count = 0;
+    for (int i = 0; count < 600; ++i) {
+        builder.append("piece").append(i).append(' ');
+        count += sprintf(expected + count, "piece%d ", i);
+    }
+    testCheck(builder.capacity > StringBuilder::inlineCapacity, "long text moves to the heap");
+    testCheck(builder.count == count && memcmp(builder.chars, expected, count) == 0 && builder.chars[count] == '\0', "text survives the move");
+
+    builder.clear();
+    testCheck(builder.count == 0 && builder.chars[0] == '\0', "clear");
+    builder.destroy();
+    testCheck(builder.capacity == StringBuilder::inlineCapacity && builder.count == 0, "destroy returns to the inline buffer");
+
+    builder.append(INT64_MIN).append(' ').append(UINT64_MAX).append(' ').append(0).append(' ').append(-7);
+    testCheck(builder.view() == "-9223372036854775808 18446744073709551615 0 -7", "integers: %s", builder.chars);
+}
+
+// Formatted text that doesn't fit the rest of the buffer is formatted a second time.
+static void testAppendFormatRetry() {
+    char text[64];
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    for (int length = 0; length < 20; ++length) {
+        StringBuilder builder;
+        int prefix = StringBuilder::inlineCapacity - 10;
+        for (int i = 0; i < prefix; ++i) {
+            builder.append('a');
+        }
+        builder.appendFormat("%.*s|%d", length, text, length);
+        char expected[StringBuilder::inlineCapacity + 64];
+        memset(expected, 'a', prefix);
+        int count = prefix + sprintf(expected + prefix, "%.*s|%d", length, text, length);
+        testCheck(builder.count == count && memcmp(builder.chars, expected, count + 1) == 0, "format of %d chars after %d", length, prefix);
+    }
+
+    StringBuilder builder;
+    builder.appendFormat("%s %s", text, text);
+    builder.appendFormat("%s%s%s%s%s", text, text, text, text, text);
+    testCheck(builder.count == 63 * 7 + 1 && builder.chars[builder.count] == '\0', "format from the inline buffer to the heap");
+}
+
+int main() {
+    testResolveRelativePath();
+    testStringBuilderSpill();
+    testAppendFormatRetry();
+    return testResult();
+}
@@ -0,0 +1,185 @@
+#include "test.hpp"
+#include "../utf.hpp"
+#include <string.h>
+
+// Every case is checked at each position within and across the 16 and 32 byte blocks of the
+// SSE2 paths, padded with ASCII before and after so blocks around it take the vector path.
+
+struct ValidCase {
+    const char* name;
+    const char* utf8;
+    uint16_t utf16[3];
+};
+
+static const ValidCase validCases[]{
+    { "ASCII", "A", { 0x41 } },
+    { "2-byte minimum", "\xC2\x80", { 0x80 } },
+    { "2-byte", "\xC3\xA9", { 0xE9 } },
+    { "3-byte minimum", "\xE0\xA0\x80", { 0x800 } },
+    { "3-byte", "\xE2\x82\xAC", { 0x20AC } },
+    { "before surrogates", "\xED\x9F\xBF", { 0xD7FF } },
+    { "after surrogates", "\xEE\x80\x80", { 0xE000 } },
+    { "3-byte maximum", "\xEF\xBF\xBF", { 0xFFFF } },
+    { "4-byte minimum", "\xF0\x90\x80\x80", { 0xD800, 0xDC00 } },
+    { "4-byte", "\xF0\x9F\x98\x80", { 0xD83D, 0xDE00 } },
+    { "4-byte maximum", "\xF4\x8F\xBF\xBF", { 0xDBFF, 0xDFFF } },
+};
+
+struct InvalidUtf8Case {
+    const char* name;
+    const char* utf8;
+};
+
+static const InvalidUtf8Case invalidUtf8Cases[]{
+    { "overlong 2-byte", "\xC0\xAF" },
+    { "overlong 2-byte maximum", "\xC1\xBF" },
+    { "overlong 3-byte", "\xE0\x80\xAF" },
+    { "overlong 3-byte maximum", "\xE0\x9F\xBF" },
+    { "overlong 4-byte", "\xF0\x80\x80\xAF" },
+    { "overlong 4-byte maximum", "\xF0\x8F\xBF\xBF" },
+    { "high surrogate", "\xED\xA0\x80" },
+    { "low surrogate", "\xED\xBF\xBF" },
+    { "surrogate pair", "\xED\xA0\xBD\xED\xB8\x80" },
+    { "truncated 2-byte", "\xC3" },
+    { "truncated 3-byte", "\xE2\x82" },
+    { "truncated 4-byte", "\xF0\x9F\x98" },
+    { "out of range", "\xF4\x90\x80\x80" },
+    { "out of range lead byte", "\xF5\x80\x80\x80" },
+    { "invalid byte", "\xFF" },
+    { "lone continuation byte", "\x80" },
+    { "ASCII instead of continuation", "\xE2\x28\xA1" },
+};
+
+struct InvalidUtf16Case {
+    const char* name;
+    uint16_t utf16[2];
+    int count;
+};
+
+static const InvalidUtf16Case invalidUtf16Cases[]{
+    { "lone high surrogate", { 0xD800 }, 1 },
+    { "lone low surrogate", { 0xDC00 }, 1 },
+    { "high surrogate before ASCII", { 0xDBFF, 0x41 }, 2 },
+    { "two high surrogates", { 0xD800, 0xD800 }, 2 },
+    { "reversed pair", { 0xDC00, 0xD800 }, 2 },
+};
+
+const int maxPadding = 40;
+const int bufferSize = 2 * maxPadding + 16;
+
+static int unitCountOf(const ValidCase& test) {
+    return test.utf16[1] == 0 ? 1 : test.utf16[2] == 0 ? 2 : 3;
+}
+
+// Places text after padding ASCII characters and pads it to maxPadding characters after.
+template<typename T>
+static int pad(T* out, const T* text, int count, int padding) {
+    int size = 0;
+    for (int i = 0; i < padding; ++i) {
+        out[size++] = (T)('a' + i % 26);
+    }
+    memcpy(out + size, text, count * sizeof(T));
+    size += count;
+    for (int i = 0; i < maxPadding - padding; ++i) {
+        out[size++] = (T)('A' + i % 26);
+    }
+    return size;
+}
+
+// UTF-16 as the bytes of a document in the given byte order.
+static void toBytes(const uint16_t* units, int count, bool bigEndian, char* out) {
+    for (int i = 0; i < count; ++i) {
+        out[i * 2 + (bigEndian ? 0 : 1)] = (char)(units[i] >> 8);
+        out[i * 2 + (bigEndian ? 1 : 0)] = (char)units[i];
+    }
+}
+
+static void testValid() {
+    for (const auto& test : validCases) {
+        for (int padding = 0; padding <= maxPadding; ++padding) {
+            char utf8[bufferSize];
+            uint16_t utf16[bufferSize];
+            int utf8Count = pad(utf8, test.utf8, (int)strlen(test.utf8), padding);
+            int utf16Count = pad(utf16, test.utf16, unitCountOf(test), padding);
+
+            uint16_t units[bufferSize];
+            testCheck(utf8ToUtf16Size(utf8, utf8Count) == utf16Count, "%s at %d: UTF-16 size", test.name, padding);
+            testCheck(utf8ToUtf16(utf8, utf8Count, units) == utf16Count && memcmp(units, utf16, utf16Count * 2) == 0,
+                "%s at %d: UTF-8 to UTF-16", test.name, padding);
+
+            char bytes[utf16ToUtf8MaxSize(bufferSize)];
+            testCheck(utf16ToUtf8Size(utf16, utf16Count) == utf8Count, "%s at %d: UTF-8 size", test.name, padding);
+            testCheck(utf16ToUtf8(utf16, utf16Count, bytes) == utf8Count && memcmp(bytes, utf8, utf8Count) == 0,
+                "%s at %d: UTF-16 to UTF-8", test.name, padding);
+
+            for (int bigEndian = 0; bigEndian < 2; ++bigEndian) {
+                // One byte in, so loads are unaligned like in a document after an odd-sized BOM.
+                char document[bufferSize * 2 + 1];
+                toBytes(utf16, utf16Count, bigEndian != 0, document + 1);
+                testCheck(utf16BytesToUtf8(document + 1, utf16Count, bigEndian != 0, bytes) == utf8Count && memcmp(bytes, utf8, utf8Count) == 0,
+                    "%s at %d: UTF-16%s document to UTF-8", test.name, padding, bigEndian ? "BE" : "LE");
+            }
+        }
+    }
+}
+
+static void testInvalidUtf8() {
+    for (const auto& test : invalidUtf8Cases) {
+        for (int padding = 0; padding <= maxPadding; ++padding) {
+            char utf8[bufferSize];
+            int utf8Count = pad(utf8, test.utf8, (int)strlen(test.utf8), padding);
+            uint16_t units[bufferSize];
+            testCheck(utf8ToUtf16Size(utf8, utf8Count) == -1, "%s at %d: UTF-16 size", test.name, padding);
+            testCheck(utf8ToUtf16(utf8, utf8Count, units) == -1, "%s at %d: UTF-8 to UTF-16", test.name, padding);
+        }
+        // Truncated at the very end, without padding after it.
+        int count = (int)strlen(test.utf8);
+        uint16_t units[bufferSize];
+        testCheck(utf8ToUtf16Size(test.utf8, count) == -1 && utf8ToUtf16(test.utf8, count, units) == -1, "%s at the end", test.name);
+    }
+}
+
+static void testInvalidUtf16() {
+    for (const auto& test : invalidUtf16Cases) {
+        for (int padding = 0; padding <= maxPadding; ++padding) {
+            uint16_t utf16[bufferSize];
+            int utf16Count = pad(utf16, test.utf16, test.count, padding);
+            char bytes[utf16ToUtf8MaxSize(bufferSize)];
+            testCheck(utf16ToUtf8Size(utf16, utf16Count) == -1, "%s at %d: UTF-8 size", test.name, padding);
+            testCheck(utf16ToUtf8(utf16, utf16Count, bytes) == -1, "%s at %d: UTF-16 to UTF-8", test.name, padding);
+
+            // Documents aren't validated, unpaired surrogates become U+FFFD.
+            char document[bufferSize * 2];
+            toBytes(utf16, utf16Count, false, document);
+            int count = utf16BytesToUtf8(document, utf16Count, false, bytes);
+            int replacements = 0;
+            for (int i = 0; i + 3 <= count; ++i) {
+                replacements += memcmp(bytes + i, "\xEF\xBF\xBD", 3) == 0;
+            }
+            testCheck(replacements >= 1 && count == maxPadding + replacements * 3 + (test.count - replacements),
+                "%s at %d: UTF-16 document to UTF-8", test.name, padding);
+        }
+        // Cut off at the very end.
+        char bytes[16];
+        testCheck(utf16ToUtf8Size(test.utf16, test.count) == -1 && utf16ToUtf8(test.utf16, test.count, bytes) == -1, "%s at the end", test.name);
+    }
+}
+
+static void testDetectEncoding() {
+    int bomSize;
+    testCheck(detectXmlEncoding("\xEF\xBB\xBF<a/>", 7, &bomSize) == TextEncoding::Utf8 && bomSize == 3, "UTF-8 BOM");
+    testCheck(detectXmlEncoding("\xFF\xFE<\0", 4, &bomSize) == TextEncoding::Utf16LE && bomSize == 2, "UTF-16LE BOM");
+    testCheck(detectXmlEncoding("\xFE\xFF\0<", 4, &bomSize) == TextEncoding::Utf16BE && bomSize == 2, "UTF-16BE BOM");
+    testCheck(detectXmlEncoding("<\0?\0", 4, &bomSize) == TextEncoding::Utf16LE && bomSize == 0, "UTF-16LE declaration");
+    testCheck(detectXmlEncoding("\0<\0?", 4, &bomSize) == TextEncoding::Utf16BE && bomSize == 0, "UTF-16BE declaration");
+    testCheck(detectXmlEncoding("<a/>", 4, &bomSize) == TextEncoding::Utf8 && bomSize == 0, "no BOM");
+    testCheck(detectXmlEncoding("\xFF", 1, &bomSize) == TextEncoding::Utf8 && bomSize == 0, "truncated BOM");
+}
+
+int main() {
+    testValid();
+    testInvalidUtf8();
+    testInvalidUtf16();
+    testDetectEncoding();
+    return testResult();
+}
@@ -0,0 +1,301 @@
+#include "test.hpp"
+#include "../arena.hpp"
+#include "../string.hpp"
+#include "../xml.hpp"
+
+// Trees are compared through a description of their elements, attributes and text, so a
+// mismatch shows where the trees differ.
+static void describeTree(StringBuilder& out, const XmlNode* node) {
+    if (node->type == XmlNodeType::Text) {
+        auto text = ((const XmlText*)node)->text;
+        out.append('"').append(text).append('"');
+        return;
+    }
+    auto element = (const XmlElement*)node;
+    out.append('<').append(element->name);
+    if (element->rawAttributes.count > 0) {
+        out.append(' ').append(element->rawAttributes);
+    }
+    out.append('>');
+    for (auto child : element->children) {
+        describeTree(out, child);
+    }
+    out.append("</").append(element->name).append('>');
+}
+
+static void appendParagraphs(StringBuilder& page, int count) {
+    page.append("<html xmlns=\"http://www.w3.org/1999/xhtml\"><body>\n");
+    for (int i = 0; i < count; ++i) {
+        // Start tags directly followed by '<', which is where chunk boundaries usually fall.
+        page.appendFormat("<div class=\"d%d\"><p id='p%d'><em>Paragraph</em> %d &amp; text</p>", i % 7, i, i);
+        page.appendFormat("<img src=\"images/%d.jpg\" alt=\"\"/><br/></div>\n", i);
+    }
+    page.append("</body></html>\n");
+}
+
+// Plain markup must be tokenized in parallel without falling back to the serial parse, and
+// must give the same tree.
+static void testParallelMatchesSerial() {
+    StringBuilder page;
+    appendParagraphs(page, 3000);
+
+    ScratchScope scratch;
+    XmlParseOptions options;
+    options.arena = scratch.arena;
+    options.parallelMinSize = 0;
+    StringBuilder serial;
+    describeTree(serial, parseXml(page.view(), options));
+
+    for (int chunkCount = 2; chunkCount <= 16; ++chunkCount) {
+        auto root = parseXmlParallel(page.view(), options, chunkCount);
+        testCheck(root != nullptr, "%d chunks fell back to the serial parse", chunkCount);
+        if (root) {
+            StringBuilder parallel;
+            describeTree(parallel, root);
+            testCheck(parallel.view() == serial.view(), "%d chunks give a different tree", chunkCount);
+        }
+    }
+}
+
+static const char samplePage[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE html>\n"
+    "<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n"
+    "<head><title>T &amp; t</title><script>if (a &lt; b) { x = 1; }</script></head>\n"
+    "<body class='b'>\n"
+    "  <!-- comment with <tags> -->\n"
+    "  <p id=\"p1\">One &lt;two&gt; &#x41;&#66;<![CDATA[<raw> & ]]>end</p>\n"
+    "  <svg><image xlink:href=\"a.png\"/></svg>\n"
+    "  <br/><img src=\"x.png\" alt=\"\"/><p>\xC3\xA9t\xC3\xA9</p>\n"
+    "</body>\n"
+    "</html>\n";
+
+// Input written in two parts must give the same tree wherever it is split, also inside
+// tags, references, comments and skipped elements.
+static void testPushParserSplits() {
+    static const StringView skipElements[]{ "head", "script" };
+    XmlParseOptions options;
+    options.skipElements = skipElements;
+    options.skipElementCount = _countof(skipElements);
+    options.dropWhiteSpaceText = true;
+    StringView page = samplePage;
+
+    ScratchScope scratch;
+    options.arena = scratch.arena;
+    StringBuilder expected;
+    describeTree(expected, parseXml(page, options));
+
+    for (int split = 0; split <= page.count; ++split) {
+        ScratchScope splitScratch;
+        XmlStreamParser parser;
+        parser.init(splitScratch.arena->allocateString(page.count).chars, page.count, options);
+        parser.write(page.chars, split);
+        parser.write(page.chars + split, page.count - split);
+        StringBuilder tree;
+        describeTree(tree, parser.finish());
+        testCheck(tree.view() == expected.view(), "split at %d gives a different tree", split);
+    }
+}
+
+// Tokens as text, with the elements named "skip" skipped.
+static void describeTokens(StringBuilder& out, const StringView& source, bool lazyAttributes) {
+    XmlParser parser;
+    parser.init(source);
+    parser.lazyAttributes = lazyAttributes;
+    XmlToken token;
+    while (parser.next(&token)) {
+        switch (token.type) {
+            case XmlTokenType::StartElement: {
+                out.append('<').append(token.startElementName).append('>');
+                if (token.startElementName == "skip") {
+                    parser.skipElement();
+                }
+            } break;
+            case XmlTokenType::EndElement: out.append("</").append(token.endElementName).append('>'); break;
+            case XmlTokenType::Attribute: out.append('@').append(token.attribute.key); break;
+            case XmlTokenType::Text: out.append('"').append(token.text).append('"'); break;
+            default: break;
+        }
+    }
+    parser.destroy();
+}
+
+static void testSkipElement() {
+    static const char source[] =
+        "<a><skip x='1'><b y=\"2\">text</b><skip/><c/><![CDATA[</skip>]]><!-- </skip> --></skip>"
+        "<skip/><skip z='>'/><d e='3'>t</d></a>";
+    const char* expected = "<a><skip></skip><skip></skip><skip></skip><d>\"t\"</d></a>";
+    for (int lazy = 0; lazy < 2; ++lazy) {
+        StringBuilder tokens;
+        describeTokens(tokens, source, lazy != 0);
+        if (lazy) {
+            testCheck(tokens.view() == expected, "lazy attributes: %s", tokens.chars);
+        } else {
+            // Attributes of elements that aren't skipped are still tokenized.
+            testCheck(tokens.view() == "<a><skip></skip><skip></skip><skip></skip><d>@e\"t\"</d></a>", "attributes: %s", tokens.chars);
+        }
+    }
+}
+
+static void testLazyAttributes() {
+    ScratchScope scratch;
+    XmlParseOptions options;
+    options.arena = scratch.arena;
+    auto root = parseXml("<p a=\"1\" b='x &amp; y' c=\"a'b\" d='a\"b' e=\"\" xml:lang=\"en\" n=\"42\" t=\"true\"/>", options);
+    testCheck(root->attr("a") == "1", "plain value");
+    testCheck(root->attr("c") == "a'b" && root->attr("d") == "a\"b", "quotes inside values");
+    testCheck(root->attr("e").count == 0 && root->attr("missing").count == 0, "empty and missing values");
+    testCheck(root->attrInt("n") == 42 && root->attrBoolean("t"), "int and boolean values");
+    testCheck(!root->attributesParsed, "values without references are read from the source");
+
+    auto decoded = root->attr("b");
+    testCheck(decoded == "x & y", "value with a reference is decoded");
+    testCheck(root->attr("b").chars == decoded.chars, "decoded value is kept");
+    testCheck(root->attr("xml:lang") == "en" && root->attr(XmlNamespaceXml, "lang") == "en", "prefixed key");
+    testCheck(root->attr("a") == "1" && root->attr("missing").count == 0, "lookups after parsing");
+}
+
+struct EntityCase {
+    const char* text;
+    const char* decoded;
+};
+
+static const EntityCase entityCases[]{
+    { "no references", "no references" },
+    { "a &amp; b", "a & b" },
+    { "&lt;&gt;&quot;&apos;", "<>\"'" },
+    { "&#65;&#x42;&#X43;", "ABC" },
+    { "&#xe9;&#x20AC;&#x1F600;", "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80" },
+    { "&&amp;&", "&&&" },
+    // Unknown and malformed references are kept.
+    { "&unknown;", "&unknown;" },
+    { "&amp", "&amp" },
+    { "& amp;", "& amp;" },
+    { "&#;", "&#;" },
+    { "&#x;", "&#x;" },
+    { "&#xZZ;", "&#xZZ;" },
+    { "&#12a;", "&#12a;" },
+    { "&#0;", "&#0;" },
+    { "&#xD800;", "&#xD800;" },
+    { "&#x110000;", "&#x110000;" },
+    { "&#x00000000041;", "&#x00000000041;" },
+};
+
+static void testEntities() {
+    ScratchScope scratch;
+    for (const auto& test : entityCases) {
+        testCheck(decodeXmlEntities(wrapCString(test.text), scratch.arena) == wrapCString(test.decoded), "decoding %s", test.text);
+    }
+
+    XmlParseOptions options;
+    options.arena = scratch.arena;
+    auto root = parseXml("<r><p>a &amp; <![CDATA[<b> &amp;]]> c &#x41;</p><p><![CDATA[x]]></p><p>a<!-- c -->b</p><p>&amp;<![CDATA[]]></p></r>", options);
+    auto paragraphs = root->findElements("p");
+    testCheck(paragraphs.count == 4, "paragraphs");
+    if (paragraphs.count == 4) {
+        testCheck(paragraphs[0]->text() == "a & <b> &amp; c A", "text around CDATA: %.*s", paragraphs[0]->text().count, paragraphs[0]->text().chars);
+        testCheck(paragraphs[1]->text() == "x", "CDATA only");
+        testCheck(paragraphs[2]->text() == "ab", "text around a comment");
+        testCheck(paragraphs[3]->text() == "&", "empty CDATA");
+    }
+    paragraphs.destroy();
+}
+
+static void testNamespaces() {
+    ScratchScope scratch;
+    XmlParseOptions options;
+    options.arena = scratch.arena;
+    auto root = parseXml(
+        "<root xmlns=\"urn:default\" xmlns:a=\"urn:a\">"
+        "<child xmlns:b=\"urn:b\" a:x=\"1\" b:y=\"2\" z=\"3\"><inner xmlns:a=\"urn:other\" a:x=\"4\"/></child>"
+        "</root>", options);
+    auto document = root->document;
+    int defaultAtom = document->findNamespace("urn:default");
+    int aAtom = document->findNamespace("urn:a");
+    int bAtom = document->findNamespace("urn:b");
+    int otherAtom = document->findNamespace("urn:other");
+    testCheck(defaultAtom > XmlNamespaceXml && aAtom > XmlNamespaceXml && bAtom > XmlNamespaceXml && otherAtom > XmlNamespaceXml, "namespaces are interned");
+    testCheck(document->findNamespace("urn:undeclared") == -1, "undeclared namespace");
+
+    auto child = root->element("child");
+    auto inner = child ? child->element("inner") : nullptr;
+    testCheck(inner != nullptr, "elements");
+    if (!inner) return;
+
+    testCheck(root->resolveNamespacePrefix("") == defaultAtom && root->resolveNamespacePrefix("a") == aAtom, "prefixes of the root");
+    testCheck(root->resolveNamespacePrefix("b") == -1, "prefix declared by a child");
+    testCheck(child->resolveNamespacePrefix("a") == aAtom && child->resolveNamespacePrefix("b") == bAtom, "inherited and own prefixes");
+    testCheck(inner->resolveNamespacePrefix("a") == otherAtom, "redeclared prefix");
+    testCheck(inner->resolveNamespacePrefix("xml") == XmlNamespaceXml && inner->resolveNamespacePrefix("c") == -1, "xml and unbound prefixes");
+
+    testCheck(child->attr(aAtom, "x") == "1" && child->attr(bAtom, "y") == "2", "prefixed attributes");
+    // The default namespace doesn't apply to attributes.
+    testCheck(child->attr(XmlNamespaceNone, "z") == "3" && child->attr(defaultAtom, "z").count == 0, "unprefixed attribute");
+    testCheck(inner->attr(aAtom, "x").count == 0 && inner->attr(otherAtom, "x") == "4", "attribute of a redeclared prefix");
+    testCheck(child->attr(-1, "x").count == 0, "unknown namespace");
+}
+
+static void testTagSet() {
+    static const StringView names[]{ "img", "image", "svg", "p", "br", "table", "tbody", "blockquote" };
+    XmlTagSet tags;
+    tags.init(names, _countof(names));
+    testCheck(!tags.linear, "small set is hashed");
+    for (const auto& name : names) {
+        testCheck(tags.contains(name), "%.*s is in the set", name.count, name.chars);
+    }
+    testCheck(tags.contains("IMG") && tags.contains("Image") && tags.contains("BlockQuote"), "names match ignoring case");
+    static const StringView misses[]{ "im", "imgs", "images", "i", "b", "tr", "imh", "smg", "tablf", "blockquotes", "x" };
+    for (const auto& name : misses) {
+        testCheck(!tags.contains(name), "%.*s is not in the set", name.count, name.chars);
+    }
+
+    // Sets that are too large for the table compare names one by one.
+    StringBuilder manyNames;
+    StringView many[40];
+    for (int i = 0; i < 40; ++i) {
+        manyNames.appendFormat("n%d ", i);
+    }
+    for (int i = 0, start = 0; i < 40; ++i) {
+        int end = start;
+        while (manyNames.chars[end] != ' ') ++end;
+        many[i] = { manyNames.chars + start, end - start };
+        start = end + 1;
+    }
+    XmlTagSet large;
+    large.init(many, 40);
+    testCheck(large.linear, "large set is linear");
+    testCheck(large.contains("n0") && large.contains("N39") && !large.contains("n40") && !large.contains("n"), "large set lookups");
+}
+
+// Documents parsed without an arena own their tree and transcoded text until destroy(), which
+// leak checks of BOOKVIEW_SANITIZE builds see.
+static void testOwnedDocuments() {
+    // "<a>é</a>" in UTF-16.
+    const char utf16[] = "\xFF\xFE<\0a\0>\0\xE9\0<\0/\0a\0>\0";
+    auto root = parseXml({ (char*)utf16, (int)sizeof(utf16) - 1 });
+    testCheck(root->text() == "\xC3\xA9", "UTF-16 text is transcoded");
+    testCheck(root->document->arena == &root->document->ownArena, "document owns its arena");
+    root->document->destroy();
+
+    StringBuilder page;
+    appendParagraphs(page, 3000);
+    XmlParseOptions options;
+    options.parallelMinSize = 1;
+    root = parseXmlParallel(page.view(), options, 4);
+    testCheck(root != nullptr, "document without an arena is tokenized in parallel");
+    if (root) {
+        root->document->destroy();
+    }
+}
+
+int main() {
+    testParallelMatchesSerial();
+    testOwnedDocuments();
+    testPushParserSplits();
+    testSkipElement();
+    testLazyAttributes();
+    testEntities();
+    testNamespaces();
+    testTagSet();
+    return testResult();
+}
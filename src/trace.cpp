@@ -0,0 +1,132 @@
+#include "trace.hpp"
+#include "string.hpp"
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+
+std::atomic<bool> tracingEnabled;
+
+struct TraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t end;
+    uint32_t threadId;
+};
+
+// Ring buffers are handed to the next new thread when their thread exits, so threads that
+// are started for every large document don't add a buffer each. Events keep the id of the
+// thread that recorded them.
+struct TraceRing {
+    static const int capacity = 8 * 1024;
+
+    TraceEvent events[capacity];
+    std::atomic<uint64_t> written;
+    TraceRing* next;
+    TraceRing* nextFree;
+};
+
+static std::atomic<TraceRing*> allRings;
+static TraceRing* freeRings;
+static std::atomic_flag ringLock = ATOMIC_FLAG_INIT;
+static std::atomic<uint32_t> nextThreadId;
+
+static void lockRings() {
+    while (ringLock.test_and_set(std::memory_order_acquire)) {
+    }
+}
+
+static void unlockRings() {
+    ringLock.clear(std::memory_order_release);
+}
+
+struct ThreadTrace {
+    TraceRing* ring = nullptr;
+    uint32_t threadId = 0;
+
+    ~ThreadTrace() {
+        if (ring) {
+            lockRings();
+            ring->nextFree = freeRings;
+            freeRings = ring;
+            unlockRings();
+        }
+    }
+};
+
+static thread_local ThreadTrace threadTrace;
+
+static TraceRing* acquireRing() {
+    lockRings();
+    auto ring = freeRings;
+    if (ring) {
+        freeRings = ring->nextFree;
+        unlockRings();
+        return ring;
+    }
+    unlockRings();
+
+    void* memory = malloc(sizeof(TraceRing));
+    verify(memory);
+    ring = new (memory) TraceRing();
+    lockRings();
+    ring->next = allRings.load(std::memory_order_relaxed);
+    allRings.store(ring, std::memory_order_release);
+    unlockRings();
+    return ring;
+}
+
+void enableTracing(bool enabled) {
+    tracingEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t traceTimestamp() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void recordTraceSpan(const char* name, int64_t start, int64_t end) {
+    auto& trace = threadTrace;
+    if (!trace.ring) {
+        trace.ring = acquireRing();
+        trace.threadId = nextThreadId.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+    auto ring = trace.ring;
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    auto& event = ring->events[index % TraceRing::capacity];
+    event.name = name;
+    event.start = start;
+    event.end = end;
+    event.threadId = trace.threadId;
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+static void appendJsonString(StringBuilder& out, const char* str) {
+    out.append('"');
+    for (; *str; ++str) {
+        if (*str == '"' || *str == '\\') {
+            out.append('\\');
+        }
+        out.append(*str);
+    }
+    out.append('"');
+}
+
+void appendChromeTrace(StringBuilder& out) {
+    out.append("{\"traceEvents\":[");
+    bool first = true;
+    for (auto ring = allRings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        uint64_t begin = written > TraceRing::capacity ? written - TraceRing::capacity : 0;
+        for (uint64_t i = begin; i < written; ++i) {
+            const auto& event = ring->events[i % TraceRing::capacity];
+            out.append(first ? "\n" : ",\n");
+            first = false;
+            out.append("{\"name\":");
+            appendJsonString(out, event.name);
+            // Timestamps are in microseconds.
+            out.appendFormat(",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                event.start / 1000.0, (event.end - event.start) / 1000.0, event.threadId);
+        }
+    }
+    out.append("\n]}\n");
+}
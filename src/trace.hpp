@@ -0,0 +1,41 @@
+#pragma once
+#include "common.hpp"
+#include <stdint.h>
+#include <atomic>
+
+struct StringBuilder;
+
+// Timing spans for finding out where time goes in opening books and turning pages. Spans
+// are recorded only while tracing is enabled; otherwise a span costs one load and a branch.
+// Each thread records into a ring buffer of its own, so recording takes no lock, and the
+// oldest spans are overwritten once it is full.
+extern std::atomic<bool> tracingEnabled;
+
+void enableTracing(bool enabled);
+int64_t traceTimestamp();
+void recordTraceSpan(const char* name, int64_t start, int64_t end);
+
+// Records the time from construction to destruction under name, which has to be a string
+// literal or otherwise outlive the trace.
+struct TraceSpan {
+    const char* name;
+    int64_t start;
+
+    explicit TraceSpan(const char* name) : name(name), start(0) {
+        if (tracingEnabled.load(std::memory_order_relaxed)) {
+            start = traceTimestamp();
+        }
+    }
+    ~TraceSpan() {
+        if (start) {
+            recordTraceSpan(name, start, traceTimestamp());
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// Appends recorded spans of all threads as Chrome trace event JSON, which chrome://tracing
+// and Perfetto load. Spans that are recorded meanwhile may be missing or torn, so export
+// when other threads are idle.
+void appendChromeTrace(StringBuilder& out);
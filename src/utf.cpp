@@ -0,0 +1,322 @@
+#include "utf.hpp"
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define UTF_SSE2
+#include <emmintrin.h>
+#endif
+
+TextEncoding detectXmlEncoding(const char* data, int size, int* bomSize) {
+    auto bytes = (const uint8_t*)data;
+    *bomSize = 0;
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        *bomSize = 3;
+        return TextEncoding::Utf8;
+    }
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        *bomSize = 2;
+        return TextEncoding::Utf16LE;
+    }
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        *bomSize = 2;
+        return TextEncoding::Utf16BE;
+    }
+    if (size >= 4 && bytes[0] == '<' && bytes[1] == 0 && bytes[2] == '?' && bytes[3] == 0) {
+        return TextEncoding::Utf16LE;
+    }
+    if (size >= 4 && bytes[0] == 0 && bytes[1] == '<' && bytes[2] == 0 && bytes[3] == '?') {
+        return TextEncoding::Utf16BE;
+    }
+    return TextEncoding::Utf8;
+}
+
+int encodeUtf8(uint32_t codePoint, char* out) {
+    if (codePoint < 0x80) {
+        out[0] = (char)codePoint;
+        return 1;
+    } else if (codePoint < 0x800) {
+        out[0] = (char)(0xC0 | (codePoint >> 6));
+        out[1] = (char)(0x80 | (codePoint & 0x3F));
+        return 2;
+    } else if (codePoint < 0x10000) {
+        out[0] = (char)(0xE0 | (codePoint >> 12));
+        out[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (codePoint & 0x3F));
+        return 3;
+    } else {
+        out[0] = (char)(0xF0 | (codePoint >> 18));
+        out[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out[3] = (char)(0x80 | (codePoint & 0x3F));
+        return 4;
+    }
+}
+
+#ifdef UTF_SSE2
+// True if all 16 code units in a and b are ASCII.
+static inline bool isAsciiUnits(__m128i a, __m128i b) {
+    __m128i nonAscii = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16((short)0xFF80));
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+
+static inline uint32_t readUnit(const uint8_t* src, bool bigEndian) {
+    return bigEndian ? ((uint32_t)src[0] << 8) | src[1] : ((uint32_t)src[1] << 8) | src[0];
+}
+
+int utf16BytesToUtf8(const char* src, int unitCount, bool bigEndian, char* dst) {
+    auto now = (const uint8_t*)src;
+    auto end = now + (size_t)unitCount * 2;
+    char* out = dst;
+
+    while (now < end) {
+#ifdef UTF_SSE2
+        // Markup is mostly ASCII, so 16 units at a time are narrowed to bytes as long as
+        // they all are below 0x80.
+        while (end - now >= 32) {
+            __m128i a = _mm_loadu_si128((const __m128i*)now);
+            __m128i b = _mm_loadu_si128((const __m128i*)(now + 16));
+            if (bigEndian) {
+                a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+                b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+            }
+            if (!isAsciiUnits(a, b)) {
+                break;
+            }
+            _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+            now += 32;
+            out += 16;
+        }
+        if (now >= end) {
+            break;
+        }
+#endif
+
+        // Scalar path for a short run of characters, then try the vector path again.
+        auto runEnd = end - now > 32 ? now + 32 : end;
+        while (now < runEnd) {
+            uint32_t unit = readUnit(now, bigEndian);
+            now += 2;
+            if (unit < 0x80) {
+                *out++ = (char)unit;
+                continue;
+            }
+            uint32_t codePoint = unit;
+            if (unit >= 0xD800 && unit <= 0xDFFF) {
+                codePoint = 0xFFFD;
+                if (unit <= 0xDBFF && now < end) {
+                    uint32_t low = readUnit(now, bigEndian);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        codePoint = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                        now += 2;
+                    }
+                }
+            }
+            out += encodeUtf8(codePoint, out);
+        }
+    }
+
+    return (int)(out - dst);
+}
+
+static inline bool isSurrogate(uint32_t unit) {
+    return unit >= 0xD800 && unit <= 0xDFFF;
+}
+
+// Decodes the sequence at now. Returns its length or 0 if it is invalid, overlong, encodes
+// a surrogate or is cut off by end.
+static inline int decodeUtf8(const uint8_t* now, const uint8_t* end, uint32_t* codePoint) {
+    uint32_t c = now[0];
+    if (c < 0x80) {
+        *codePoint = c;
+        return 1;
+    }
+
+    int length;
+    uint32_t minimum;
+    if (c < 0xC2) {
+        return 0; // Continuation byte or overlong 2-byte sequence.
+    } else if (c < 0xE0) {
+        length = 2;
+        minimum = 0x80;
+        c &= 0x1F;
+    } else if (c < 0xF0) {
+        length = 3;
+        minimum = 0x800;
+        c &= 0x0F;
+    } else if (c < 0xF5) {
+        length = 4;
+        minimum = 0x10000;
+        c &= 0x07;
+    } else {
+        return 0;
+    }
+
+    if (end - now < length) {
+        return 0;
+    }
+    for (int i = 1; i < length; ++i) {
+        if ((now[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        c = (c << 6) | (now[i] & 0x3F);
+    }
+    if (c < minimum || c > 0x10FFFF || isSurrogate(c)) {
+        return 0;
+    }
+    *codePoint = c;
+    return length;
+}
+
+// Both directions handle ASCII 16 characters at a time and fall back to scalar code for
+// 16 characters when a block has anything else, which keeps mixed text like CJK file
+// names with ASCII directories on the vector path where possible.
+
+int utf16ToUtf8Size(const uint16_t* src, int count) {
+    const uint16_t* now = src;
+    const uint16_t* end = src + count;
+    int size = 0;
+    while (now < end) {
+#ifdef UTF_SSE2
+        while (end - now >= 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)now);
+            __m128i b = _mm_loadu_si128((const __m128i*)(now + 8));
+            if (!isAsciiUnits(a, b)) {
+                break;
+            }
+            now += 16;
+            size += 16;
+        }
+#endif
+        auto runEnd = end - now > 16 ? now + 16 : end;
+        while (now < runEnd) {
+            uint32_t unit = *now++;
+            if (unit < 0x80) {
+                size += 1;
+            } else if (unit < 0x800) {
+                size += 2;
+            } else if (!isSurrogate(unit)) {
+                size += 3;
+            } else if (unit <= 0xDBFF && now < end && *now >= 0xDC00 && *now <= 0xDFFF) {
+                ++now;
+                size += 4;
+            } else {
+                return -1;
+            }
+        }
+    }
+    return size;
+}
+
+int utf16ToUtf8(const uint16_t* src, int count, char* dst) {
+    const uint16_t* now = src;
+    const uint16_t* end = src + count;
+    char* out = dst;
+    while (now < end) {
+#ifdef UTF_SSE2
+        while (end - now >= 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)now);
+            __m128i b = _mm_loadu_si128((const __m128i*)(now + 8));
+            if (!isAsciiUnits(a, b)) {
+                break;
+            }
+            _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+            now += 16;
+            out += 16;
+        }
+#endif
+        auto runEnd = end - now > 16 ? now + 16 : end;
+        while (now < runEnd) {
+            uint32_t unit = *now++;
+            if (unit < 0x80) {
+                *out++ = (char)unit;
+                continue;
+            }
+            uint32_t codePoint = unit;
+            if (isSurrogate(unit)) {
+                if (unit > 0xDBFF || now >= end || *now < 0xDC00 || *now > 0xDFFF) {
+                    return -1;
+                }
+                codePoint = 0x10000 + ((unit - 0xD800) << 10) + (*now++ - 0xDC00);
+            }
+            out += encodeUtf8(codePoint, out);
+        }
+    }
+    return (int)(out - dst);
+}
+
+int utf8ToUtf16Size(const char* src, int count) {
+    auto now = (const uint8_t*)src;
+    auto end = now + count;
+    int size = 0;
+    while (now < end) {
+#ifdef UTF_SSE2
+        while (end - now >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)now);
+            if (_mm_movemask_epi8(chunk) != 0) {
+                break;
+            }
+            now += 16;
+            size += 16;
+        }
+#endif
+        auto runEnd = end - now > 16 ? now + 16 : end;
+        while (now < runEnd) {
+            if (*now < 0x80) {
+                ++now;
+                ++size;
+                continue;
+            }
+            uint32_t codePoint;
+            int length = decodeUtf8(now, end, &codePoint);
+            if (length == 0) {
+                return -1;
+            }
+            now += length;
+            size += codePoint >= 0x10000 ? 2 : 1;
+        }
+    }
+    return size;
+}
+
+int utf8ToUtf16(const char* src, int count, uint16_t* dst) {
+    auto now = (const uint8_t*)src;
+    auto end = now + count;
+    uint16_t* out = dst;
+    while (now < end) {
+#ifdef UTF_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        while (end - now >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i*)now);
+            if (_mm_movemask_epi8(chunk) != 0) {
+                break;
+            }
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(chunk, zero));
+            now += 16;
+            out += 16;
+        }
+#endif
+        auto runEnd = end - now > 16 ? now + 16 : end;
+        while (now < runEnd) {
+            if (*now < 0x80) {
+                *out++ = *now++;
+                continue;
+            }
+            uint32_t codePoint;
+            int length = decodeUtf8(now, end, &codePoint);
+            if (length == 0) {
+                return -1;
+            }
+            now += length;
+            if (codePoint >= 0x10000) {
+                codePoint -= 0x10000;
+                *out++ = (uint16_t)(0xD800 + (codePoint >> 10));
+                *out++ = (uint16_t)(0xDC00 + (codePoint & 0x3FF));
+            } else {
+                *out++ = (uint16_t)codePoint;
+            }
+        }
+    }
+    return (int)(out - dst);
+}
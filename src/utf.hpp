@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+
+// UTF-8 and UTF-16 transcoding. This file doesn't depend on the rest of the program or on the
+// platform, so it can be built and checked anywhere.
+
+enum class TextEncoding {
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+};
+
+// Detects encoding of an XML document from its byte order mark, or from how "<?" at its
+// start is encoded. Documents without either are UTF-8. bomSize is set to the number of
+// bytes to skip.
+TextEncoding detectXmlEncoding(const char* data, int size, int* bomSize);
+
+// Writes UTF-8 encoding of codePoint to out, returns number of bytes written (1 to 4).
+int encodeUtf8(uint32_t codePoint, char* out);
+
+// Every UTF-16 code unit takes at most 3 bytes in UTF-8, every UTF-8 byte at most one
+// UTF-16 code unit.
+inline int utf16ToUtf8MaxSize(int unitCount) { return unitCount * 3; }
+inline int utf8ToUtf16MaxSize(int byteCount) { return byteCount; }
+
+// Transcodes unitCount UTF-16 code units read from unaligned bytes in src, used for documents
+// of either byte order. dst must hold utf16ToUtf8MaxSize(unitCount) bytes. Unpaired surrogates
+// become U+FFFD. Returns number of bytes written.
+int utf16BytesToUtf8(const char* src, int unitCount, bool bigEndian, char* dst);
+
+// Validating transcoders. The *Size functions return the exact size of the result, so it can
+// be allocated once; the others convert in a single pass into a buffer of the maximum size.
+// All of them return -1 if src is not valid UTF-8 or UTF-16 (unpaired surrogates, overlong
+// or truncated sequences).
+int utf16ToUtf8Size(const uint16_t* src, int count);
+int utf16ToUtf8(const uint16_t* src, int count, char* dst);
+int utf8ToUtf16Size(const char* src, int count);
+int utf8ToUtf16(const char* src, int count, uint16_t* dst);
@@ -1,35 +1,306 @@
 #include "xml.hpp"
 #include "string.hpp"
-#include <stdlib.h> // _countof
+#include "utf.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define XML_SSE2
+#include <emmintrin.h>
+#endif
+
+constexpr XmlCharClassTable::XmlCharClassTable() : classes() {
+    for (int c = 'a'; c <= 'z'; ++c) classes[c] |= XmlCharNameStart | XmlCharName;
+    for (int c = 'A'; c <= 'Z'; ++c) classes[c] |= XmlCharNameStart | XmlCharName;
+    for (int c = '0'; c <= '9'; ++c) classes[c] |= XmlCharName;
+    classes['-'] |= XmlCharNameStart | XmlCharName;
+    classes[':'] |= XmlCharNameStart | XmlCharName;
+    classes[' '] |= XmlCharWhiteSpace;
+    classes['\t'] |= XmlCharWhiteSpace;
+    classes['\r'] |= XmlCharNewLine;
+    classes['\n'] |= XmlCharNewLine;
+    classes['"'] |= XmlCharDoubleQuote;
+    classes['\''] |= XmlCharSingleQuote;
+}
+
+constexpr XmlCharClassTable xmlCharClasses;
 
 inline static bool isWhiteSpace(char c) {
-    return c == ' ' || c == '\t';
+    return hasXmlCharClass(c, XmlCharWhiteSpace);
 }
 
 inline static bool isNewLine(char c) {
-    return c == '\r' || c == '\n';
+    return hasXmlCharClass(c, XmlCharNewLine);
+}
+
+// Returns pointer to the first character in [now, end) that has any of the classes in stopMask.
+inline static char* scanUntil(char* now, char* end, uint8_t stopMask) {
+    while (now < end && !(xmlCharClasses.classes[(uint8_t)*now] & stopMask)) {
+        ++now;
+    }
+    return now;
+}
+
+// Returns pointer to the first character in [now, end) that has none of the classes in mask.
+inline static char* scanWhile(char* now, char* end, uint8_t mask) {
+    while (now < end && (xmlCharClasses.classes[(uint8_t)*now] & mask)) {
+        ++now;
+    }
+    return now;
 }
 
-void XmlParser::init(const String& source) {
+void XmlParser::init(const StringView& source) {
     start = source.chars;
     now = start;
     end = source.chars + source.count;
+    finished = true;
+}
+
+void XmlParser::initIncremental(char* buffer) {
+    start = buffer;
+    now = start;
+    end = start;
+    finished = false;
+}
+
+void XmlParser::feed(int count) {
+    verify(!finished);
+    verify(count >= 0);
+    end += count;
+}
+
+void XmlParser::finish() {
+    finished = true;
 }
 
 void XmlParser::destroy() {
 }
 
 bool XmlParser::next(XmlToken* token) {
+    if (failed) {
+        return false;
+    }
+
+    if (skipDepth > 0) {
+        starved = false;
+        if (!skipElementContent()) {
+            return false;
+        }
+        token->type = XmlTokenType::EndElement;
+        token->endElementName = skippedElementName;
+        --elementDepth;
+        if (elementDepth < 0) return fail("End tag without start tag");
+        return true;
+    }
+
+    // Remember where the token started, so a token that is cut off by the end of available
+    // input can be scanned again from the beginning once more input is fed.
+    char* tokenStart = now;
+    StringView savedLastElementTagName = lastElementTagName;
+    int savedElementDepth = elementDepth;
+    bool savedInsideDeclaration = insideDeclaration;
+    bool savedInsideElement = insideElement;
+
+    starved = false;
+    if (nextToken(token)) {
+        return true;
+    }
+
+    if (stopped()) {
+        now = tokenStart;
+        lastElementTagName = savedLastElementTagName;
+        elementDepth = savedElementDepth;
+        insideDeclaration = savedInsideDeclaration;
+        insideElement = savedInsideElement;
+    }
+    return false;
+}
+
+bool XmlParser::available() {
+    if (now < end) {
+        return true;
+    }
+    return suspend();
+}
+
+bool XmlParser::suspend() {
+    if (finished) {
+        return fail("Unexpected end of document");
+    }
+    starved = true;
+    return false;
+}
+
+// Malformed input. Only speculative parsers recover from it, they just stop.
+bool XmlParser::fail(const char* message) {
+    if (!speculative) {
+        failImpl(FailureKind::MalformedXml, message, __FILE__, __LINE__);
+    }
+    failed = true;
+    return false;
+}
+
+static inline int countTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Returns pointer to the first occurrence of c in [now, end) or end.
+static const char* findChar(const char* now, const char* end, char c) {
+#ifdef XML_SSE2
+    const __m128i pattern = _mm_set1_epi8(c);
+    while (end - now >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)now);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pattern));
+        if (mask) {
+            return now + countTrailingZeros((unsigned int)mask);
+        }
+        now += 16;
+    }
+#endif
+    while (now < end && *now != c) {
+        ++now;
+    }
+    return now;
+}
+
+// Returns pointer past the first occurrence of terminator in [now, end) or nullptr.
+static const char* findTerminator(const char* now, const char* end, const StringView& terminator) {
+    while (true) {
+        now = findChar(now, end, terminator[0]);
+        if (end - now < terminator.count) {
+            return nullptr;
+        }
+        if (memcmp(now, terminator.chars, terminator.count) == 0) {
+            return now + terminator.count;
+        }
+        ++now;
+    }
+}
+
+static bool startsWith(const char* now, const char* end, const StringView& prefix) {
+    return end - now >= prefix.count && memcmp(now, prefix.chars, prefix.count) == 0;
+}
+
+// Moves to the '>' that ends the current tag, skipping over attribute values.
+bool XmlParser::scanToTagEnd() {
+    while (true) {
+        if (now >= end) {
+            return suspend();
+        }
+        char c = *now;
+        if (c == '"' || c == '\'') {
+            auto quoteEnd = findChar(now + 1, end, c);
+            if (quoteEnd >= end) {
+                return suspend();
+            }
+            now = (char*)quoteEnd + 1;
+        } else if (c == '>') {
+            return true;
+        } else {
+            ++now;
+        }
+    }
+}
+
+// Must be called right after a StartElement token. Its tag may still be open, or already
+// closed when attributes are lazy.
+void XmlParser::skipElement() {
+    verify(skipDepth == 0);
+    skipDepth = 1;
+    skippedElementName = lastElementTagName;
+}
+
+// Scans to the end of the skipped element by looking only at markup: '<' is found with a
+// vectorized search and only tags that change the nesting depth are inspected. Progress is
+// kept when input runs out, so a skip that spans many chunks never rescans them.
+bool XmlParser::skipElementContent() {
+    while (true) {
+        if (insideElement) {
+            if (!scanToTagEnd()) {
+                return false;
+            }
+            bool selfClosing = now[-1] == '/';
+            ++now;
+            insideElement = false;
+            if (selfClosing && --skipDepth == 0) {
+                return true;
+            }
+        }
+
+        now = (char*)findChar(now, end, '<');
+        if (end - now < 2) {
+            return suspend();
+        }
+
+        const char* tagEnd = nullptr;
+        switch (now[1]) {
+            case '/': {
+                tagEnd = findChar(now + 2, end, '>');
+                if (tagEnd < end) {
+                    now = (char*)tagEnd + 1;
+                    if (--skipDepth == 0) {
+                        return true;
+                    }
+                    continue;
+                }
+            } break;
+
+            case '!': {
+                if (startsWith(now, end, "<!--")) {
+                    tagEnd = findTerminator(now + 4, end, "-->");
+                } else if (startsWith(now, end, "<![CDATA[")) {
+                    tagEnd = findTerminator(now + 9, end, "]]>");
+                } else if (end - now >= 9) {
+                    tagEnd = findTerminator(now + 2, end, ">");
+                }
+                if (tagEnd) {
+                    now = (char*)tagEnd;
+                    continue;
+                }
+            } break;
+
+            case '?': {
+                tagEnd = findTerminator(now + 2, end, "?>");
+                if (tagEnd) {
+                    now = (char*)tagEnd;
+                    continue;
+                }
+            } break;
+
+            default: {
+                ++now;
+                ++skipDepth;
+                insideElement = true;
+                continue;
+            } break;
+        }
+
+        // Tag is not complete yet, continue from its '<' when more input arrives.
+        return suspend();
+    }
+}
+
+bool XmlParser::nextToken(XmlToken* token) {
     bool skippedTextWhiteSpace = false;
     while (true) {
         if (insideDeclaration) {
             parseDeclarationTag(token);
-            return true;
+            return !stopped();
         } else if (insideElement) {
             if (parseElementTag(token)) {
                 continue;
             }
-            return true;
+            return !stopped();
         }
 
         if (elementDepth <= 0) {
@@ -37,57 +308,67 @@ bool XmlParser::next(XmlToken* token) {
         }
 
         if (now >= end) {
+            starved = !finished;
             return false;
         }
 
         char c = *now;
         if (c == '<') {
             ++now;
-            verify(now < end);
+            if (!available()) return false;
             c = *now;
             if (c == '?') {
                 ++now;
-                verify(now < end);
+                if (!available()) return false;
 
                 insideDeclaration = true;
                 token->type = XmlTokenType::StartDeclaration;
                 token->declarationName = parseAttributeKey();
-                return true;
+                return !stopped();
             } else if (c == '!') {
-                // Skip !DOCTYPE
-                ++now;
-                do {
-                    verify(now < end);
-                    c = *now++;
-                    if (c == '>') {
-                        break;
-                    }
-                } while (true);
-                continue;
+                if (parseBangTag(token)) {
+                    return true;
+                }
+                if (stopped()) return false;
+                continue; // Scan next token.
             } else if (c == '/') {
                 ++now;
-                verify(now < end);
-                String name = parseAttributeKey();
-                verify(now < end);
-                verify(*now == '>');
+                if (!available()) return false;
+                StringView name = parseAttributeKey();
+                if (stopped() || !available()) return false;
+                if (*now != '>') return fail("Expected '>' after end tag name");
                 ++now;
                 token->type = XmlTokenType::EndElement;
                 token->endElementName = name;
                 --elementDepth;
-                verify(elementDepth >= 0);
+                if (elementDepth < 0) return fail("End tag without start tag");
                 return true;
-            } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || c == ':') {
+            } else if (hasXmlCharClass(c, XmlCharNameStart)) {
                 insideElement = true;
                 token->type = XmlTokenType::StartElement;
                 token->startElementName = parseAttributeKey();
+                if (stopped()) return false;
+                if (lazyAttributes) {
+                    // Return the attribute list as is. "/>" is left to be handled like after the
+                    // last attribute, '>' is consumed so that a chunk can end right after it.
+                    char* attributesStart = now;
+                    if (!scanToTagEnd()) return false;
+                    bool selfClosing = now[-1] == '/';
+                    if (selfClosing) --now;
+                    token->rawAttributes = { attributesStart, (int)(now - attributesStart) };
+                    if (!selfClosing) {
+                        ++now;
+                        insideElement = false;
+                    }
+                }
                 lastElementTagName = token->startElementName;
                 ++elementDepth;
                 return true;
             } else {
-                verify(false);
+                return fail("Expected tag name after '<'");
             }
         } else {
-            verify(!skippedTextWhiteSpace);
+            if (skippedTextWhiteSpace) return fail("Text outside of the root element");
             if (elementDepth <= 0) {
                 skipWhiteSpaceAndNewLines();
                 skippedTextWhiteSpace = true;
@@ -98,60 +379,107 @@ bool XmlParser::next(XmlToken* token) {
             }
         }
 
-        verify(false);
+        return fail("Unexpected character");
+    }
+}
+
+// Skips comments and !DOCTYPE, CDATA sections are returned as Text tokens. Called with `now`
+// at the '!'. Returns true if a token was produced.
+bool XmlParser::parseBangTag(XmlToken* token) {
+    char* tagStart = now - 1;
+    if (end - tagStart < 9 && !finished) {
+        // Can't tell "<!--" and "<![CDATA[" from other tags yet.
+        return suspend();
+    }
+
+    if (startsWith(tagStart, end, "<!--")) {
+        auto commentEnd = findTerminator(tagStart + 4, end, "-->");
+        if (!commentEnd) return suspend();
+        now = (char*)commentEnd;
         return false;
     }
+
+    if (startsWith(tagStart, end, "<![CDATA[")) {
+        char* textStart = tagStart + 9;
+        auto cdataEnd = findTerminator(textStart, end, "]]>");
+        if (!cdataEnd) return suspend();
+        if (elementDepth <= 0) return fail("CDATA outside of the root element");
+        now = (char*)cdataEnd;
+        int count = (int)(cdataEnd - 3 - textStart);
+        if (count == 0) {
+            return false;
+        }
+        token->type = XmlTokenType::Text;
+        token->text = { textStart, count };
+        token->cdata = true;
+        return true;
+    }
+
+    // !DOCTYPE, '>' inside of the internal subset doesn't end it.
+    int bracketDepth = 0;
+    for (char* p = now + 1; p < end; ++p) {
+        char c = *p;
+        if (c == '[') {
+            ++bracketDepth;
+        } else if (c == ']') {
+            --bracketDepth;
+        } else if (c == '>' && bracketDepth <= 0) {
+            now = p + 1;
+            return false;
+        }
+    }
+    return suspend();
 }
 
+// When input is incomplete, text is returned in pieces that end at the end of available input.
 void XmlParser::parseText(XmlToken* token) {
     char* start = now;
-    while (now < end) {
-        char c = *now;
-        // @TODO: c == special character, not just '<'.
-        if (c == '<') {
-            break;
-        } else {
-            ++now;
-        }
-    }
+    // @TODO: Stop at special characters, not just '<'.
+    now = (char*)findChar(now, end, '<');
     int count = (int)(now - start);
     verify(count > 0);
     token->type = XmlTokenType::Text;
     token->text = { start, count };
+    token->cdata = false;
 }
 
 void XmlParser::parseAttribute(XmlToken* token) {
     auto key = parseAttributeKey();
-    skipWhiteSpace();
-    verify(now < end);
-    verify(*now == '=');
+    if (stopped()) return;
+    skipWhiteSpaceAndNewLines();
+    if (!available()) return;
+    if (*now != '=') {
+        fail("Expected '=' after attribute name");
+        return;
+    }
     ++now;
-    skipWhiteSpace();
+    skipWhiteSpaceAndNewLines();
     auto value = parseAttributeValue();
+    if (stopped()) return;
 
     token->type = XmlTokenType::Attribute;
     token->attribute.key = key;
     token->attribute.value = value;
 }
 
-String XmlParser::parseAttributeKey() {
+StringView XmlParser::parseAttributeKey() {
     char* start = now;
-    while (now < end) {
-        char c = *now;
-        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == ':') {
-            ++now;
-        } else {
-            break;
-        }
+    now = scanWhile(now, end, XmlCharName);
+    if (now >= end && !finished) {
+        starved = true;
+        return {};
     }
     int count = (int)(now - start);
-    verify(count > 0);
+    if (count == 0) {
+        fail("Expected attribute name");
+        return {};
+    }
     return { start, count };
 }
 
-String XmlParser::parseAttributeValue() {
+StringView XmlParser::parseAttributeValue() {
     auto start = now;
-    verify(now < end);
+    if (!available()) return {};
     char quoteChar = 0;
     char c = *now;
     if (c == '"' || c == '\'') {
@@ -160,37 +488,45 @@ String XmlParser::parseAttributeValue() {
         ++now;
     }
 
-    while (now < end) {
-        char c = *now;
-        if (quoteChar ? c == quoteChar : isWhiteSpace(c)) {
-            break;
-        } else if (isNewLine(c)) {
-            verify(false);
-        } else {
-            ++now;
-        }
+    uint8_t stopMask = XmlCharNewLine;
+    switch (quoteChar) {
+        case '"':  stopMask |= XmlCharDoubleQuote; break;
+        case '\'': stopMask |= XmlCharSingleQuote; break;
+        default:   stopMask |= XmlCharWhiteSpace; break;
+    }
+    now = scanUntil(now, end, stopMask);
+    if (now < end && isNewLine(*now)) {
+        fail("Line break in unquoted attribute value");
+        return {};
+    }
+    if (now >= end && !finished) {
+        starved = true;
+        return {};
     }
     int count = (int)(now - start);
-    verify(quoteChar || count > 0);
+    if (!quoteChar && count == 0) {
+        fail("Empty attribute value");
+        return {};
+    }
     if (quoteChar) ++now;
 
     return { start, count };
 }
 
 void XmlParser::parseDeclarationTag(XmlToken* token) {
-    skipWhiteSpace();
-    verify(now < end);
+    skipWhiteSpaceAndNewLines();
+    if (!available()) return;
     char c = *now;
     if (c == '?') {
         ++now;
-        verify(now < end);
+        if (!available()) return;
         c = *now;
         if (c == '>') {
             ++now;
             token->type = XmlTokenType::EndDeclaration;
             insideDeclaration = false;
         } else {
-            verify(false); // Expected '>' after '?' (end of declaration)
+            fail("Expected '>' after '?' at the end of a declaration");
         }
     } else {
         parseAttribute(token);
@@ -198,13 +534,13 @@ void XmlParser::parseDeclarationTag(XmlToken* token) {
 }
 
 bool XmlParser::parseElementTag(XmlToken* token) {
-    skipWhiteSpace();
-    verify(now < end);
+    skipWhiteSpaceAndNewLines();
+    if (!available()) return false;
     char c = *now;
     bool selfClosing = c == '/';
     if (selfClosing) {
         ++now;
-        verify(now < end);
+        if (!available()) return false;
         c = *now;
     }
 
@@ -215,144 +551,534 @@ bool XmlParser::parseElementTag(XmlToken* token) {
             token->type = XmlTokenType::EndElement;
             token->endElementName = lastElementTagName;
             --elementDepth;
-            verify(elementDepth >= 0);
+            if (elementDepth < 0) return fail("End tag without start tag");
         } else {
             return true;
         }
     } else {
-        verify(!selfClosing);
+        if (selfClosing) return fail("Expected '>' after '/'");
         parseAttribute(token);
     }
     return false;
 }
 
-void XmlParser::skipWhiteSpace() {
-    while (now < end) {
-        if (isWhiteSpace(*now)) {
-            ++now;
-        } else {
-            break;
-        }
+bool XmlParser::nextAttribute(XmlAttribute* attribute) {
+    skipWhiteSpaceAndNewLines();
+    if (now >= end) {
+        return false;
     }
+    XmlToken token;
+    parseAttribute(&token);
+    *attribute = token.attribute;
+    return true;
 }
 
 void XmlParser::skipWhiteSpaceAndNewLines() {
-    while (now < end) {
-        char c = *now;
-        if (isWhiteSpace(c) || isNewLine(c)) {
-            ++now;
-        } else {
-            break;
+    now = scanWhile(now, end, XmlCharWhiteSpace | XmlCharNewLine);
+}
+
+// Decodes the reference that starts at the '&' at `now` into out. Returns pointer past the
+// reference or nullptr if it is not a reference we know. Decoded text is never longer
+// than the reference.
+static const char* decodeReference(const char* now, const char* end, char** out) {
+    const int maxReferenceLength = 12; // "&#x0010FFFF;"
+    const char* limit = end - now > maxReferenceLength ? now + maxReferenceLength : end;
+    const char* semicolon = findChar(now + 1, limit, ';');
+    if (semicolon == limit) {
+        return nullptr;
+    }
+    StringView name{ (char*)now + 1, (int)(semicolon - now - 1) };
+
+    if (name.count >= 2 && name[0] == '#') {
+        bool hex = name[1] == 'x' || name[1] == 'X';
+        int i = hex ? 2 : 1;
+        if (i == name.count) {
+            return nullptr;
+        }
+        uint32_t codePoint = 0;
+        for (; i < name.count; ++i) {
+            char c = name[i];
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (hex && (c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+                digit = (c | 0x20) - 'a' + 10;
+            } else {
+                return nullptr;
+            }
+            codePoint = codePoint * (hex ? 16 : 10) + digit;
+            if (codePoint > 0x10FFFF) {
+                return nullptr;
+            }
+        }
+        if (codePoint == 0 || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+            return nullptr;
         }
+        *out += encodeUtf8(codePoint, *out);
+        return semicolon + 1;
     }
+
+    char c;
+    if (name == "amp") c = '&';
+    else if (name == "lt") c = '<';
+    else if (name == "gt") c = '>';
+    else if (name == "quot") c = '"';
+    else if (name == "apos") c = '\'';
+    else return nullptr;
+    *(*out)++ = c;
+    return semicolon + 1;
 }
 
-XmlText* parseText(XmlParser& parser, const XmlToken& thisTextToken) {
-    auto result = new XmlText();
-    result->type = XmlNodeType::Text;
-    result->text = thisTextToken.text;
+StringView decodeXmlEntities(const StringView& text, Arena* arena) {
+    const char* now = text.chars;
+    const char* end = text.chars + text.count;
+    const char* ampersand = findChar(now, end, '&');
+    if (ampersand == end) {
+        return text;
+    }
+
+    auto result = arena->allocateString(text.count);
+    char* out = result.chars;
+    while (true) {
+        memcpy(out, now, ampersand - now);
+        out += ampersand - now;
+        now = ampersand;
+        if (now == end) {
+            break;
+        }
+        auto referenceEnd = decodeReference(now, end, &out);
+        if (referenceEnd) {
+            now = referenceEnd;
+        } else {
+            *out++ = '&';
+            ++now;
+        }
+        ampersand = findChar(now, end, '&');
+    }
+    result.count = (int)(out - result.chars);
     return result;
 }
 
-XmlElement* parseElement(XmlParser& parser, const XmlToken& thisElementToken) {
-    XmlToken token;
-    auto element = new XmlElement();
-    element->type = XmlNodeType::Element;
-    element->name = thisElementToken.startElementName;
+void XmlStreamParser::init(char* buffer, int capacity, const XmlParseOptions& options) {
+    MemoryPhaseScope phase(MemoryPhase::ParseXml);
+    this->options = options;
+    this->buffer = buffer;
+    this->capacity = capacity;
+    this->count = 0;
+    if (options.document) {
+        document = options.document;
+    } else if (options.arena) {
+        document = options.arena->create<XmlDocument>();
+        document->arena = options.arena;
+    } else {
+        document = new XmlDocument();
+    }
+    document->type = XmlNodeType::Document;
+    document->internNamespace("");
+    document->internNamespace("http://www.w3.org/XML/1998/namespace");
+    parser.initIncremental(buffer);
+    parser.lazyAttributes = true;
+}
+
+XmlStreamParser::~XmlStreamParser() {
+    parser.destroy();
+    openElements.destroy();
+    openChildren.destroy();
+    childrenStarts.destroy();
+    if (document && !document->root && !options.arena) {
+        document->destroy();
+    }
+}
+
+XmlDocumentScope::XmlDocumentScope(const XmlParseOptions& options) : options(options) {
+    if (!options.arena) {
+        owned = new XmlDocument();
+        this->options.document = owned;
+        this->options.arena = &owned->ownArena;
+    }
+}
 
-    // Attributes
+XmlDocumentScope::~XmlDocumentScope() {
+    if (owned) {
+        owned->destroy();
+    }
+}
+
+void XmlStreamParser::write(const void* data, int size) {
+    verify(size >= 0 && size <= capacity - count);
+    memcpy(buffer + count, data, size);
+    commit(size);
+}
+
+void XmlStreamParser::commit(int size) {
+    MemoryPhaseScope phase(MemoryPhase::ParseXml);
+    verify(size >= 0 && size <= capacity - count);
+    count += size;
+    parser.feed(size);
+    consume();
+}
+
+XmlElement* XmlStreamParser::finish() {
+    MemoryPhaseScope phase(MemoryPhase::ParseXml);
+    parser.finish();
+    consume();
+    parser.destroy();
+    return finishTree();
+}
+
+XmlElement* XmlStreamParser::finishTree() {
+    verifyInput(openElements.count == 0, FailureKind::MalformedXml, "Element is not closed");
+    verifyInput(root, FailureKind::MalformedXml, "Document has no root element");
+    openElements.destroy();
+    openChildren.destroy();
+    childrenStarts.destroy();
+    document->root = root;
+    return root;
+}
+
+bool XmlStreamParser::shouldSkip(const StringView& elementName) const {
+    for (int i = 0; i < options.skipElementCount; ++i) {
+        if (stringEqualsCaseInsensitive(elementName, options.skipElements[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void XmlStreamParser::consume() {
+    XmlToken token;
     while (parser.next(&token)) {
-        switch (token.type) {
-            case XmlTokenType::Attribute: {
-                element->attributes.push(token.attribute);
-            } break;
-            default: {
-                goto finishAttributes;
-            }
+        handleToken(token);
+        if (token.type == XmlTokenType::StartElement && shouldSkip(token.startElementName)) {
+            parser.skipElement();
         }
     }
+}
 
-finishAttributes:
+void XmlStreamParser::handleToken(const XmlToken& token) {
+    switch (token.type) {
+        case XmlTokenType::StartDeclaration: {
+            verifyInput(!root, FailureKind::MalformedXml, "Declaration after the root element");
+            insideDeclaration = true;
+        } break;
 
-    do {
-        switch (token.type) {
-            case XmlTokenType::EndElement: {
-                verify(thisElementToken.startElementName == token.endElementName);
-                return element;
+        case XmlTokenType::EndDeclaration: {
+            verify(insideDeclaration);
+            insideDeclaration = false;
+        } break;
+
+        case XmlTokenType::Attribute: {
+            verify(insideDeclaration);
+        } break;
+
+        case XmlTokenType::StartElement: {
+            auto element = document->arena->create<XmlElement>();
+            element->type = XmlNodeType::Element;
+            element->document = document;
+            element->name = token.startElementName;
+            element->rawAttributes = token.rawAttributes;
+            if (openElements.count > 0) {
+                element->namespaces = openElements.last()->namespaces;
             }
-            case XmlTokenType::StartElement: {
-                element->children.push(parseElement(parser, token));
-            } break;
-            case XmlTokenType::Text: {
-                element->children.push(parseText(parser, token));
-            } break;
-            default: {
-                verify(false);
-            } break;
-        }
-    } while (parser.next(&token));
+            if (findTerminator(element->rawAttributes.chars, element->rawAttributes.chars + element->rawAttributes.count, "xmlns")) {
+                declareNamespaces(element);
+            }
+            if (openElements.count > 0) {
+                openChildren.push(element);
+            } else {
+                // We can parse multiple elements at root level, but for now we don't need it.
+                verifyInput(!root, FailureKind::MalformedXml, "More than one root element");
+                root = element;
+            }
+            openElements.push(element);
+            childrenStarts.push(openChildren.count);
+        } break;
 
-    verify(false);
-    return nullptr;
+        case XmlTokenType::EndElement: {
+            verifyInput(openElements.count > 0, FailureKind::MalformedXml, "End tag without start tag");
+            auto element = openElements.last();
+            verifyInput(element->name == token.endElementName, FailureKind::MalformedXml, "End tag doesn't match start tag");
+            int firstChild = childrenStarts.last();
+            int childCount = openChildren.count - firstChild;
+            element->children.reserve(childCount, document->arena);
+            element->children.pushMultiple(openChildren.data + firstChild, childCount);
+            openChildren.count = firstChild;
+            childrenStarts.pop();
+            openElements.pop();
+        } break;
+
+        case XmlTokenType::Text: {
+            if (openElements.count == 0) {
+                // Only speculatively tokenized chunks produce text outside of the root element.
+                for (int i = 0; i < token.text.count; ++i) {
+                    verifyInput(isWhiteSpace(token.text[i]) || isNewLine(token.text[i]), FailureKind::MalformedXml, "Text outside of the root element");
+                }
+                break;
+            }
+
+            // Text that was split at a chunk boundary continues the previous text node.
+            if (!token.cdata && openChildren.count > childrenStarts.last() && openChildren.last()->type == XmlNodeType::Text) {
+                auto previous = (XmlText*)openChildren.last();
+                if (previous->text.chars + previous->text.count == token.text.chars) {
+                    previous->text.count += token.text.count;
+                    break;
+                }
+            }
+
+            StringView content = token.text;
+            if (whiteSpaceText.chars + whiteSpaceText.count == content.chars) {
+                content = { whiteSpaceText.chars, whiteSpaceText.count + content.count };
+            }
+            whiteSpaceText = {};
+            if (options.dropWhiteSpaceText && !token.cdata
+                && scanWhile(content.chars, content.chars + content.count, XmlCharWhiteSpace | XmlCharNewLine) == content.chars + content.count) {
+                whiteSpaceText = content;
+                break;
+            }
+
+            if (openChildren.count > childrenStarts.last() && openChildren.last()->type == XmlNodeType::Text) {
+                // Text split by a CDATA section or a comment is merged, so text() finds one node.
+                auto previous = (XmlText*)openChildren.last();
+                auto before = previous->decoded ? previous->text : decodeXmlEntities(previous->text, document->arena);
+                auto after = token.cdata ? content : decodeXmlEntities(content, document->arena);
+                auto merged = document->arena->allocateString(before.count + after.count);
+                memcpy(merged.chars, before.chars, before.count);
+                memcpy(merged.chars + before.count, after.chars, after.count);
+                previous->text = merged;
+                previous->decoded = true;
+                break;
+            }
+
+            auto text = document->arena->create<XmlText>();
+            text->type = XmlNodeType::Text;
+            text->text = content;
+            text->decoded = token.cdata;
+            openChildren.push(text);
+        } break;
+
+        default: {
+            verify(false);
+        } break;
+    }
 }
 
-XmlElement* parseXml(const String& source) {
-    XmlToken token;
+// Namespace declarations are resolved to atoms once per element that has them, so lookups
+// by namespace compare integers instead of URIs.
+void XmlStreamParser::declareNamespaces(XmlElement* element) {
+    XmlParser parser;
+    parser.init(element->rawAttributes);
+    XmlAttribute attr;
+    while (parser.nextAttribute(&attr)) {
+        StringView prefix;
+        if (attr.key == "xmlns") {
+            prefix = {};
+        } else if (attr.key.count > 6 && startsWith(attr.key.chars, attr.key.chars + attr.key.count, "xmlns:")) {
+            prefix = substring(attr.key, 6, attr.key.count - 6);
+        } else {
+            continue;
+        }
+        auto binding = (XmlNamespaceBinding*)document->arena->allocate(sizeof(XmlNamespaceBinding));
+        binding->previous = element->namespaces;
+        binding->prefix = prefix;
+        binding->atom = document->internNamespace(decodeXmlEntities(attr.value, document->arena));
+        element->namespaces = binding;
+    }
+}
+
+struct XmlChunk {
     XmlParser parser;
-    parser.init(source);
-
-    XmlDocument doc;
-    doc.type = XmlNodeType::Document;
-    
-    // Skip declaration first.
-    {
-        bool insideDeclaration = false;
+    Array<XmlToken> tokens;
+    const XmlStreamParser* builder = nullptr;
+    bool succeeded = false;
+
+    ~XmlChunk() {
+        parser.destroy();
+        tokens.destroy();
+    }
+};
+
+// Chunks of parseXmlParallel, released also when building the tree from them fails.
+struct XmlChunks {
+    Array<char*> boundaries;
+    XmlChunk* chunks = nullptr;
+
+    ~XmlChunks() {
+        delete[] chunks;
+        boundaries.destroy();
+    }
+};
+
+// Speculatively assumes that a '<' that follows '>' or a line break and is followed by a name
+// character or '/' starts a tag, which is wrong inside comments, CDATA sections and attribute values.
+// A chunk that ends inside of them is left unfinished, so the guess is detected as wrong.
+static char* findChunkBoundary(char* now, char* end) {
+    while (true) {
+        now = (char*)findChar(now, end, '<');
+        if (end - now < 2) {
+            return end;
+        }
+        char previous = now[-1];
+        char c = now[1];
+        if ((previous == '>' || isNewLine(previous)) && (c == '/' || hasXmlCharClass(c, XmlCharNameStart))) {
+            return now;
+        }
+        ++now;
+    }
+}
+
+static void tokenizeChunk(XmlChunk* chunk) {
+    TraceSpan span("tokenizeChunk");
+    MemoryPhaseScope phase(MemoryPhase::ParseXml);
+    auto& parser = chunk->parser;
+    // Failures can't reach the caller from this thread. The chunk fails instead, and the
+    // serial parse that follows fails the same way on the caller's thread.
+    Failure failure;
+    bool tokenized = recoverFailures([&] {
+        XmlToken token;
         while (parser.next(&token)) {
-            switch (token.type) {
-                case XmlTokenType::StartDeclaration: {
-                    insideDeclaration = true;
-                } break;
-                case XmlTokenType::EndDeclaration: {
-                    verify(insideDeclaration);
-                    goto declarationFinished;
-                } break;
-                case XmlTokenType::Attribute: {
-                    verify(insideDeclaration);
-                } break;
-                default: {
-                    verify(!insideDeclaration);
-                    // Missing declaration.
-                    goto continueWithLastToken;
-                    break; 
-                } break;
+            chunk->tokens.push(token);
+            if (token.type == XmlTokenType::StartElement && chunk->builder->shouldSkip(token.startElementName)) {
+                parser.skipElement();
             }
         }
+    }, &failure);
+
+    // Every chunk except the last must stop exactly at the next boundary and outside of any
+    // tag, otherwise the next chunk started in the wrong state.
+    chunk->succeeded = tokenized && !parser.failed && (parser.finished || (parser.now == parser.end
+        && !parser.insideElement && !parser.insideDeclaration && parser.skipDepth == 0));
+}
+
+// Splits the document at likely tag boundaries and tokenizes the chunks in parallel. Chunks
+// other than the first don't know their element depth, so they start at an arbitrary depth
+// deep enough to never go below zero and the tree builder checks the structure. Returns
+// nullptr if any chunk boundary turned out to be wrong.
+XmlElement* parseXmlParallel(const StringView& source, const XmlParseOptions& options, int chunkCount) {
+    const int speculativeElementDepth = INT_MAX / 2;
+
+    XmlStreamParser builder;
+    builder.init(source.chars, source.count, options);
+
+    char* sourceEnd = source.chars + source.count;
+    XmlChunks parallel;
+    auto& boundaries = parallel.boundaries;
+    boundaries.push(source.chars);
+    for (int i = 1; i < chunkCount; ++i) {
+        auto boundary = findChunkBoundary(source.chars + (int64_t)source.count * i / chunkCount, sourceEnd);
+        if (boundary > boundaries.last() && boundary < sourceEnd) {
+            boundaries.push(boundary);
+        }
     }
+    boundaries.push(sourceEnd);
+    chunkCount = boundaries.count - 1;
 
-    declarationFinished: {}
+    parallel.chunks = new XmlChunk[chunkCount];
+    auto chunks = parallel.chunks;
+    for (int i = 0; i < chunkCount; ++i) {
+        auto& chunk = chunks[i];
+        chunk.builder = &builder;
+        chunk.parser.initIncremental(boundaries[i]);
+        chunk.parser.feed((int)(boundaries[i + 1] - boundaries[i]));
+        chunk.parser.lazyAttributes = true;
+        chunk.parser.speculative = true;
+        if (i > 0) {
+            chunk.parser.elementDepth = speculativeElementDepth;
+        }
+        if (i == chunkCount - 1) {
+            chunk.parser.finish();
+        }
+        chunk.tokens.reserve((int)(boundaries[i + 1] - boundaries[i]) / 32);
+    }
 
-    while (parser.next(&token)) {
-        continueWithLastToken: {}
-        switch (token.type) {
-            case XmlTokenType::StartElement: {
-                verify(doc.childCount < _countof(doc.children));
-                doc.children[doc.childCount++] = parseElement(parser, token);
-            } break;
-            default: {
-                verify(false);
-            } break;
+    Array<std::thread*> threads;
+    for (int i = 1; i < chunkCount; ++i) {
+        threads.push(new std::thread(tokenizeChunk, &chunks[i]));
+    }
+    tokenizeChunk(&chunks[0]);
+    for (auto thread : threads) {
+        thread->join();
+        delete thread;
+    }
+    threads.destroy();
+
+    bool succeeded = true;
+    for (int i = 0; i < chunkCount; ++i) {
+        succeeded = succeeded && chunks[i].succeeded;
+    }
+
+    XmlElement* root = nullptr;
+    if (succeeded) {
+        for (int i = 0; i < chunkCount; ++i) {
+            for (const auto& token : chunks[i].tokens) {
+                builder.handleToken(token);
+            }
         }
+        root = builder.finishTree();
     }
+    return root;
+}
 
-    parser.destroy();
+static XmlElement* parseXmlUtf8(const StringView& source, const XmlParseOptions& options) {
+    if (options.parallelMinSize > 0 && source.count >= options.parallelMinSize) {
+        int threadCount = (int)std::thread::hardware_concurrency();
+        int chunkCount = source.count / (1024 * 1024);
+        if (chunkCount > threadCount) chunkCount = threadCount;
+        if (chunkCount > 1) {
+            auto root = parseXmlParallel(source, options, chunkCount);
+            if (root) {
+                return root;
+            }
+            // Fall back to serial parsing.
+        }
+    }
+
+    XmlStreamParser parser;
+    parser.init(source.chars, source.count, options);
+    parser.commit(source.count);
+    return parser.finish();
+}
+
+XmlElement* parseXml(const StringView& source, const XmlParseOptions& parseOptions) {
+    TraceSpan span("parseXml");
+    MemoryPhaseScope phase(MemoryPhase::ParseXml);
+    XmlDocumentScope scope(parseOptions);
+    const auto& options = scope.options;
+    int bomSize;
+    auto encoding = detectXmlEncoding(source.chars, source.count, &bomSize);
+    if (encoding == TextEncoding::Utf8) {
+        return scope.release(parseXmlUtf8(substring(source, bomSize, source.count - bomSize), options));
+    }
 
-    // We can parse multiple elements at root level, but for now we don't need it,
-    // so we return first element.
-    verify(doc.childCount == 1);
-    return doc.children[0];
+    // The tokenizer only reads bytes, so UTF-16 is transcoded up front. The tree points into
+    // the transcoded text, so source doesn't have to outlive it.
+    verifyInput((source.count - bomSize) % 2 == 0, FailureKind::MalformedXml, "UTF-16 document has an odd number of bytes");
+    int unitCount = (source.count - bomSize) / 2;
+    int maxSize = utf16ToUtf8MaxSize(unitCount);
+    char* utf8 = options.arena->allocateString(maxSize).chars;
+    int count = utf16BytesToUtf8(source.chars + bomSize, unitCount, encoding == TextEncoding::Utf16BE, utf8);
+    return scope.release(parseXmlUtf8({ utf8, count }, options));
 }
 
-String XmlElement::attr(const String& key) const {
+StringView XmlElement::attr(const StringView& key) {
+    if (!attributesParsed) {
+        XmlParser parser;
+        parser.init(rawAttributes);
+        XmlAttribute attr;
+        while (parser.nextAttribute(&attr)) {
+            if (attr.key == key) {
+                if (indexOf(attr.value, '&') == -1) {
+                    return attr.value;
+                }
+                // Decoded values are kept, so asking again doesn't decode into the arena again.
+                parseAttributes();
+                break;
+            }
+        }
+        if (!attributesParsed) {
+            return {};
+        }
+    }
+
     for (int i = 0; i < attributes.count; ++i) {
         const auto& attr = attributes[i];
         if (attr.key == key) {
@@ -362,59 +1088,235 @@ String XmlElement::attr(const String& key) const {
     return {};
 }
 
-int XmlElement::attrInt(const String& key) const {
-    return parseInt(attr(key));
+static inline uint32_t tagHashKey(const StringView& name) {
+    // ASCII letters are folded to lower case, other characters only need to hash consistently.
+    uint32_t first = (uint8_t)name[0] | 0x20;
+    uint32_t middle = (uint8_t)name[name.count / 2] | 0x20;
+    uint32_t last = (uint8_t)name[name.count - 1] | 0x20;
+    return (uint32_t)name.count ^ (first << 8) ^ (middle << 16) ^ (last << 24);
 }
 
-Array<XmlElement*> XmlElement::getElementsByTagName(const String& name) {
-    Array<XmlElement*> results;
-    getElementsByTagName(name, results);
-    return results;
+static inline int tagHashSlot(uint32_t key, uint32_t seed, int bits) {
+    return (int)((key * seed) >> (32 - bits));
 }
 
-void XmlElement::getElementsByTagName(const String& name, Array<XmlElement*>& result) {
-    for (auto child : children) {
-        if (child->type != XmlNodeType::Element) {
+void XmlTagSet::init(const StringView* names, int count) {
+    this->names = names;
+    this->count = count;
+    lengths = 0;
+    for (int i = 0; i < count; ++i) {
+        lengths |= 1u << (names[i].count < 31 ? names[i].count : 31);
+    }
+    linear = true;
+    if (count > 32 || (lengths & 1)) {
+        return; // Too many names or an empty one.
+    }
+
+    // Try multiplicative hashes until every name gets its own slot. Names that are equal
+    // ignoring case may share a slot, they match the same elements.
+    for (tableBits = 4; (1 << tableBits) <= (int)sizeof(table); ++tableBits) {
+        if ((1 << tableBits) < count * 2) {
             continue;
         }
-        auto* element = (XmlElement*)child;
-        if (stringEqualsCaseInsensitive(element->name, name)) {
-            result.push(element);
+        for (int attempt = 0; attempt < 64; ++attempt) {
+            seed = 0x9E3779B1u + 2 * attempt * 0x2545F491u;
+            memset(table, 0, sizeof(table));
+            bool perfect = true;
+            for (int i = 0; i < count && perfect; ++i) {
+                int slot = tagHashSlot(tagHashKey(names[i]), seed, tableBits);
+                if (table[slot] == 0) {
+                    table[slot] = (uint8_t)(i + 1);
+                } else {
+                    perfect = stringEqualsCaseInsensitive(names[table[slot] - 1], names[i]);
+                }
+            }
+            if (perfect) {
+                linear = false;
+                return;
+            }
+        }
+    }
+}
+
+bool XmlTagSet::contains(const StringView& name) const {
+    if (!(lengths & (1u << (name.count < 31 ? name.count : 31)))) {
+        return false;
+    }
+    if (linear) {
+        for (int i = 0; i < count; ++i) {
+            if (stringEqualsCaseInsensitive(names[i], name)) {
+                return true;
+            }
         }
-        element->getElementsByTagName(name, result);
+        return false;
     }
+    int index = table[tagHashSlot(tagHashKey(name), seed, tableBits)];
+    return index != 0 && stringEqualsCaseInsensitive(names[index - 1], name);
 }
 
-Array<XmlElement*> XmlElement::getElementsByTagNames(const String* names, size_t count) {
+StringView XmlElement::attr(int namespaceAtom, const StringView& localName) {
+    if (namespaceAtom < 0) {
+        return {};
+    }
+    parseAttributes();
+    for (int i = 0; i < attributes.count; ++i) {
+        if (attributeNamespaces[i] != namespaceAtom) {
+            continue;
+        }
+        // The prefix was checked by its atom, only the local name after it is left to compare.
+        const auto& key = attributes[i].key;
+        int prefixCount = key.count - localName.count;
+        if (prefixCount >= 0 && (prefixCount == 0 || key[prefixCount - 1] == ':') &&
+                memcmp(key.chars + prefixCount, localName.chars, localName.count) == 0) {
+            return attributes[i].value;
+        }
+    }
+    return {};
+}
+
+int XmlElement::resolveNamespacePrefix(const StringView& prefix) const {
+    for (auto binding = namespaces; binding; binding = binding->previous) {
+        if (binding->prefix == prefix) {
+            return binding->atom;
+        }
+    }
+    if (prefix == "xml") {
+        return XmlNamespaceXml;
+    }
+    return prefix.count == 0 ? XmlNamespaceNone : -1;
+}
+
+int XmlDocument::findNamespace(const StringView& uri) const {
+    for (int i = 0; i < namespaces.count; ++i) {
+        if (namespaces[i] == uri) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void XmlDocument::destroy() {
+    if (arena == &ownArena) {
+        ownArena.destroy();
+        delete this;
+    }
+}
+
+int XmlDocument::internNamespace(const StringView& uri) {
+    int atom = findNamespace(uri);
+    if (atom == -1) {
+        if (namespaces.count == namespaces.capacity) {
+            // Grown in the arena like element children, so documents in the scratch arena
+            // don't leave it on the heap.
+            namespaces.reserve(namespaces.capacity * 2, arena);
+        }
+        atom = namespaces.count;
+        namespaces.push(uri);
+    }
+    return atom;
+}
+
+void XmlElement::parseAttributes() {
+    if (attributesParsed) {
+        return;
+    }
+    // Count attributes first, so lists that don't fit inline are moved to the arena once.
+    XmlParser parser;
+    parser.init(rawAttributes);
+    XmlAttribute attr;
+    int count = 0;
+    while (parser.nextAttribute(&attr)) {
+        ++count;
+    }
+    attributes.reserve(count, document->arena);
+    attributeNamespaces.reserve(count, document->arena);
+
+    // Unprefixed attributes are in no namespace, the default namespace only applies to elements.
+    parser.init(rawAttributes);
+    while (parser.nextAttribute(&attr)) {
+        attr.value = decodeXmlEntities(attr.value, document->arena);
+        attributes.push(attr);
+        int colonIndex = indexOf(attr.key, ':');
+        int atom = XmlNamespaceNone;
+        if (colonIndex == 0) {
+            atom = -1;
+        } else if (colonIndex > 0) {
+            atom = resolveNamespacePrefix(substring(attr.key, 0, colonIndex));
+        }
+        attributeNamespaces.push(atom);
+    }
+    attributesParsed = true;
+}
+
+int XmlElement::attrInt(const StringView& key) {
+    return parseInt(attr(key));
+}
+
+Array<XmlElement*> XmlElement::getElementsByTagName(const StringView& name) {
+    Array<XmlElement*> results;
+    getElementsByTagName(name, results);
+    return results;
+}
+
+void XmlElement::getElementsByTagName(const StringView& name, Array<XmlElement*>& result) {
+    XmlTagSet tags;
+    tags.init(&name, 1);
+    getElementsByTagNames(tags, result);
+}
+
+Array<XmlElement*> XmlElement::getElementsByTagNames(const StringView* names, size_t count) {
     Array<XmlElement*> results;
     getElementsByTagNames(names, count, results);
     return results;
 }
 
-void XmlElement::getElementsByTagNames(const String* names, size_t count, Array<XmlElement*>& result) {
-    for (auto child : children) {
-        if (child->type != XmlNodeType::Element) {
-            continue;
-        }
-        auto* element = (XmlElement*)child;
+void XmlElement::getElementsByTagNames(const StringView* names, size_t count, Array<XmlElement*>& result) {
+    XmlTagSet tags;
+    tags.init(names, (int)count);
+    getElementsByTagNames(tags, result);
+}
 
-        for (size_t i = 0; i < count; ++i) {
-            const auto& name = names[i];
-            if (stringEqualsCaseInsensitive(element->name, name)) {
-                result.push(element);
+void XmlElement::getElementsByTagNames(const XmlTagSet& tags, Array<XmlElement*>& result) {
+    // Remaining siblings of each ancestor of the current child list.
+    struct Siblings {
+        XmlNode** next;
+        XmlNode** end;
+    };
+    SmallArray<Siblings, 16> stack;
+    XmlNode** next = children.data;
+    XmlNode** end = children.data + children.count;
+    while (true) {
+        if (next == end) {
+            if (stack.count == 0) {
                 break;
             }
+            next = stack.last().next;
+            end = stack.last().end;
+            stack.pop();
+            continue;
+        }
+        auto child = *next++;
+        if (child->type != XmlNodeType::Element) {
+            continue;
+        }
+        auto element = (XmlElement*)child;
+        if (tags.contains(element->name)) {
+            result.push(element);
+        }
+        if (element->children.count > 0) {
+            stack.push({ next, end });
+            next = element->children.data;
+            end = element->children.data + element->children.count;
         }
-
-        element->getElementsByTagNames(names, count, result);
     }
+    stack.destroy();
 }
 
-bool XmlElement::attrBoolean(const String& key) const {
+bool XmlElement::attrBoolean(const StringView& key) {
     return parseBoolean(attr(key));
 }
 
-void XmlElement::findAll(const String& key, Array<XmlElement*>& result) const {
+void XmlElement::findAll(const StringView& key, Array<XmlElement*>& result) const {
     for (auto& child : children) {
         auto element = (XmlElement*)child;
         if (element->type == XmlNodeType::Element && element->name == key) {
@@ -423,7 +1325,7 @@ void XmlElement::findAll(const String& key, Array<XmlElement*>& result) const {
     }
 }
 
-Array<XmlElement*> XmlElement::findElements(const String& name) const {
+Array<XmlElement*> XmlElement::findElements(const StringView& name) const {
     Array<XmlElement*> elements;
     for (auto child : children) {
         if (child->type == XmlNodeType::Element && ((XmlElement*)child)->name == name) {
@@ -433,7 +1335,7 @@ Array<XmlElement*> XmlElement::findElements(const String& name) const {
     return elements;
 }
 
-XmlElement* XmlElement::element(const String& key) const {
+XmlElement* XmlElement::element(const StringView& key) const {
     for (auto& child : children) {
         auto element = (XmlElement*)child;
         if (element->type == XmlNodeType::Element && element->name == key) {
@@ -443,7 +1345,12 @@ XmlElement* XmlElement::element(const String& key) const {
     return nullptr;
 }
 
-String XmlElement::text() const {
+StringView XmlElement::text() const {
     verify(children.count == 1 && children.data[0]->type == XmlNodeType::Text);
-    return ((XmlText*)children.data[0])->text;
+    auto text = (XmlText*)children.data[0];
+    if (!text->decoded) {
+        text->text = decodeXmlEntities(text->text, document->arena);
+        text->decoded = true;
+    }
+    return text->text;
 }
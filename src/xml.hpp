@@ -1,6 +1,31 @@
 #pragma once
 #include "common.hpp"
 #include "array.hpp"
+#include "arena.hpp"
+#include <stdint.h>
+
+// Character classes used by the tokenizer, see xmlCharClasses.
+enum XmlCharClass : uint8_t {
+    XmlCharNameStart   = 1 << 0,
+    XmlCharName        = 1 << 1,
+    XmlCharWhiteSpace  = 1 << 2,
+    XmlCharNewLine     = 1 << 3,
+    XmlCharDoubleQuote = 1 << 4,
+    XmlCharSingleQuote = 1 << 5,
+};
+
+// Classes of every byte value, so the tokenizer's inner loops test one table entry against
+// a mask instead of a chain of range comparisons.
+struct XmlCharClassTable {
+    uint8_t classes[256];
+    constexpr XmlCharClassTable();
+};
+
+extern const XmlCharClassTable xmlCharClasses;
+
+inline bool hasXmlCharClass(char c, uint8_t mask) {
+    return (xmlCharClasses.classes[(uint8_t)c] & mask) != 0;
+}
 
 enum class XmlTokenType {
     // <?xml ... ?>
@@ -13,19 +38,23 @@ enum class XmlTokenType {
 };
 
 struct XmlAttribute {
-    String key;
-    String value;
+    StringView key;
+    StringView value;
 };
 
 struct XmlToken {
     XmlTokenType type = (XmlTokenType)0;
     union {
-        String declarationName;
+        StringView declarationName;
         XmlAttribute attribute;
-        String startElementName;
-        String endElementName;
-        String text;
+        StringView startElementName;
+        StringView endElementName;
+        StringView text;
     };
+    // Unparsed attribute list of StartElement when XmlParser::lazyAttributes is set.
+    StringView rawAttributes;
+    // Text comes from a CDATA section, so it has no entity references to decode.
+    bool cdata = false;
     inline XmlToken() {}
     void print();
 };
@@ -40,60 +69,250 @@ struct XmlNode {
     XmlNodeType type;
 };
 
+struct XmlDocument;
+
+// Case-insensitive set of element names, built once per query. Names are placed in a small
+// table by a perfect hash of their length and first, middle and last letters, so testing an
+// element is one table lookup and at most one string comparison. The names are not copied.
+struct XmlTagSet {
+    const StringView* names = nullptr;
+    int count = 0;
+    // Bit n is set if a name has length n (longer names use bit 31), rejects most elements
+    // before their name is read.
+    uint32_t lengths = 0;
+    uint32_t seed = 0;
+    int tableBits = 0;
+    // Index + 1 into names, 0 for empty slots.
+    uint8_t table[128];
+    // Set when no perfect hash was found, names are then compared one by one.
+    bool linear = false;
+
+    void init(const StringView* names, int count);
+    bool contains(const StringView& name) const;
+};
+
+// Namespace atoms index XmlDocument::namespaces.
+const int XmlNamespaceNone = 0;
+const int XmlNamespaceXml = 1;
+
+// Prefix bound by an xmlns attribute. Elements share the bindings of their parent unless
+// they declare namespaces themselves.
+struct XmlNamespaceBinding {
+    XmlNamespaceBinding* previous;
+    StringView prefix; // Empty for the default namespace.
+    int atom;
+};
+
 struct XmlElement : public XmlNode {
-    String name;
-    Array<XmlNode*> children;
+    XmlDocument* document = nullptr;
+    XmlNamespaceBinding* namespaces = nullptr;
+    StringView name;
+    // Most elements have a single child, usually text, which is stored inline. Longer lists
+    // are moved into the document arena once the element ends.
+    SmallArray<XmlNode*, 1> children;
+    // Attributes are kept as unparsed source text and parsed on lookup. parseAttributes()
+    // fills `attributes` in the document arena for elements that are queried many times. Values
+    // are returned with entity references decoded; looking up a value that has any parses the
+    // attributes, so it is decoded once.
+    StringView rawAttributes;
     Array<XmlAttribute> attributes;
+    // Namespace atom of each attribute's prefix, -1 if the prefix is not bound.
+    Array<int> attributeNamespaces;
+    bool attributesParsed = false;
 
-    String attr(const String& key) const;
-    int attrInt(const String& key) const;
-    bool attrBoolean(const String& key) const;
+    void parseAttributes();
+    StringView attr(const StringView& key);
+    // Attribute with the given local name in a namespace from XmlDocument::findNamespace.
+    // Parses the attributes on first use, so prefixes are resolved once per element.
+    StringView attr(int namespaceAtom, const StringView& localName);
+    int attrInt(const StringView& key);
+    bool attrBoolean(const StringView& key);
+    // Returns namespace atom bound to prefix in scope of this element, or -1.
+    int resolveNamespacePrefix(const StringView& prefix) const;
 
-    Array<XmlElement*> getElementsByTagName(const String& name);
-    void getElementsByTagName(const String& name, Array<XmlElement*>& result);
+    Array<XmlElement*> getElementsByTagName(const StringView& name);
+    void getElementsByTagName(const StringView& name, Array<XmlElement*>& result);
 
-    Array<XmlElement*> getElementsByTagNames(const String* names, size_t count);
-    void getElementsByTagNames(const String* names, size_t count, Array<XmlElement*>& result);
+    Array<XmlElement*> getElementsByTagNames(const StringView* names, size_t count);
+    void getElementsByTagNames(const StringView* names, size_t count, Array<XmlElement*>& result);
+    // Appends descendants in document order. The tree is walked with an explicit stack, so
+    // deep nesting doesn't overflow the call stack.
+    void getElementsByTagNames(const XmlTagSet& tags, Array<XmlElement*>& result);
 
-    void findAll(const String& key, Array<XmlElement*>& result) const;
-    Array<XmlElement*> findElements(const String& name) const;
-    XmlElement* element(const String& key) const;
-    String text() const;
+    void findAll(const StringView& key, Array<XmlElement*>& result) const;
+    Array<XmlElement*> findElements(const StringView& name) const;
+    XmlElement* element(const StringView& key) const;
+    StringView text() const;
 };
 
+// Owns memory shared by the nodes of a parsed document, like decoded text.
 struct XmlDocument : public XmlNode {
-    int childCount = 0;
-    XmlElement* children[8];
+    XmlElement* root = nullptr;
+    // Nodes and decoded text. This is ownArena, unless the document was parsed into
+    // XmlParseOptions::arena.
+    Arena* arena = &ownArena;
+    Arena ownArena;
+    // Namespace URIs declared in the document, indexed by atom. Lists longer than the inline
+    // storage are kept in arena.
+    SmallArray<StringView, 8> namespaces;
+
+    // Returns atom of the namespace, or -1 if the document never declares it.
+    int findNamespace(const StringView& uri) const;
+    int internNamespace(const StringView& uri);
+    // Frees a document parsed without XmlParseOptions::arena together with its text. Documents
+    // parsed into an arena are released with that arena.
+    void destroy();
 };
 
 struct XmlText : public XmlNode {
-    String text;
+    // Source text, entity references are decoded by XmlElement::text() on first access. Text
+    // that CDATA sections or comments split is merged into one decoded node.
+    StringView text;
+    bool decoded = false;
 };
 
+// Replaces entity and character references in text. Text without '&' is returned as is,
+// otherwise the result is allocated in arena. Unknown and malformed references are kept.
+StringView decodeXmlEntities(const StringView& text, Arena* arena);
+
 struct XmlParser {
     char* start = 0;
     char* now = 0;
     char* end = 0;
 
-    String lastElementTagName;
+    StringView lastElementTagName;
     int elementDepth = 0;
     bool insideDeclaration = false;
     bool insideElement = false;
+    // False while more input may be fed after `end`.
+    bool finished = true;
+    // Set when next() stopped because a token was cut off by the end of available input.
+    bool starved = false;
+    // Speculative parsers stop at malformed input and set `failed` instead of failing verify.
+    bool speculative = false;
+    bool failed = false;
+    // Return attribute list of StartElement as XmlToken::rawAttributes instead of Attribute tokens.
+    bool lazyAttributes = false;
+    // Nesting depth inside an element that is being skipped, see skipElement().
+    int skipDepth = 0;
+    StringView skippedElementName;
 
-    void init(const String& source);
+    void init(const StringView& source);
+    // Incremental parsing: input is appended to the buffer and made available with feed().
+    // Tokens point into the buffer, so it must not move while the parser is in use.
+    void initIncremental(char* buffer);
+    void feed(int count);
+    void finish();
     void destroy();
 
+    // Returns false at the end of the document, or when more input is needed to complete
+    // the next token.
     bool next(XmlToken* token);
+    // Skips attributes and content of the element that was just started. Nothing inside is
+    // tokenized; next() returns its EndElement token.
+    void skipElement();
+    // Iterates attributes of a raw attribute list the parser was initialized with.
+    bool nextAttribute(XmlAttribute* attribute);
 private:
+    bool nextToken(XmlToken* token);
+    bool available();
+    bool suspend();
+    bool fail(const char* message);
+    inline bool stopped() const { return starved || failed; }
+    bool skipElementContent();
+    bool scanToTagEnd();
     void parseText(XmlToken* token);
     void parseAttribute(XmlToken* token);
-    String parseAttributeKey();
-    String parseAttributeValue();
+    StringView parseAttributeKey();
+    StringView parseAttributeValue();
     void parseDeclarationTag(XmlToken* token);
-    void parseBangDeclarationTag(XmlToken* token);
+    bool parseBangTag(XmlToken* token);
     bool parseElementTag(XmlToken* token);
-    void skipWhiteSpace();
     void skipWhiteSpaceAndNewLines();
 };
 
-XmlElement* parseXml(const String& source);
\ No newline at end of file
+// How parseXml and XmlStreamParser build the tree.
+struct XmlParseOptions {
+    // Elements with these names (case-insensitive) are skipped together with their content,
+    // they appear in the tree without attributes and children.
+    const StringView* skipElements = nullptr;
+    int skipElementCount = 0;
+    // Documents of at least this size are tokenized on multiple threads. 0 disables it.
+    int parallelMinSize = 4 * 1024 * 1024;
+    // Don't create text nodes that only contain white space, like indentation between tags.
+    bool dropWhiteSpaceText = false;
+    // The tree and the text it points into are allocated in this arena when set, so
+    // temporary trees can be parsed into the scratch arena.
+    Arena* arena = nullptr;
+    // Document to build the tree in instead of creating one, set by XmlDocumentScope.
+    XmlDocument* document = nullptr;
+};
+
+// Without XmlParseOptions::arena, a parse builds a document that owns its memory. This creates
+// that document up front and points options at its arena, so buffers allocated before the parse,
+// like the inflated or transcoded source, are freed with the tree by XmlDocument::destroy. The
+// document is freed with the scope unless the parsed tree is released to the caller.
+struct XmlDocumentScope {
+    XmlParseOptions options;
+    XmlDocument* owned = nullptr;
+
+    XmlDocumentScope(const XmlParseOptions& options);
+    ~XmlDocumentScope();
+    XmlElement* release(XmlElement* root) {
+        owned = nullptr;
+        return root;
+    }
+    XmlDocumentScope(const XmlDocumentScope&) = delete;
+    XmlDocumentScope& operator=(const XmlDocumentScope&) = delete;
+};
+
+// Push-mode document parser. Input is written in arbitrary chunks and tokenized as soon as
+// it arrives. The tree points into the input buffer, so the buffer is allocated once with
+// the full document size (e.g. the uncompressed size of a zip entry) and must outlive the tree.
+struct XmlStreamParser {
+    XmlParser parser;
+    XmlParseOptions options;
+    char* buffer = nullptr;
+    int capacity = 0;
+    int count = 0;
+
+    XmlDocument* document = nullptr;
+    XmlElement* root = nullptr;
+    // Usual documents are shallow and fit the inline storage of these arrays.
+    SmallArray<XmlElement*, 32> openElements;
+    // Children of all open elements. They are moved to their element when it ends,
+    // openChildren[childrenStarts[i]] is the first child of openElements[i].
+    SmallArray<XmlNode*, 256> openChildren;
+    SmallArray<int, 32> childrenStarts;
+    // White space text that is dropped unless more text continues it.
+    StringView whiteSpaceText;
+    bool insideDeclaration = false;
+
+    // Also runs when a malformed document fails, so the spilled arrays are freed and so is a
+    // document that was never handed out.
+    ~XmlStreamParser();
+    void init(char* buffer, int capacity, const XmlParseOptions& options = {});
+    // Copies data into the buffer and parses it.
+    void write(const void* data, int size);
+    // Parses size bytes that were already placed at buffer + count.
+    void commit(int size);
+    XmlElement* finish();
+
+    // Builds the tree from tokens produced elsewhere, used by parallel parsing.
+    void handleToken(const XmlToken& token);
+    XmlElement* finishTree();
+    bool shouldSkip(const StringView& elementName) const;
+private:
+    void consume();
+    void declareNamespaces(XmlElement* element);
+};
+
+// Tokenizes a UTF-8 document in chunkCount chunks on as many threads, the way parseXml does
+// for large documents. Returns nullptr if a chunk boundary turned out to be inside markup,
+// parseXml then parses serially. Exposed so tests can force the parallel path.
+XmlElement* parseXmlParallel(const StringView& source, const XmlParseOptions& options, int chunkCount);
+
+// Parses a UTF-8 or UTF-16 document, see detectXmlEncoding. The tree points into source
+// unless it had to be transcoded. Malformed documents fail with verify, see recoverFailures.
+// Without an arena, free the tree with root->document->destroy().
+XmlElement* parseXml(const StringView& source, const XmlParseOptions& options = {});
@@ -0,0 +1,131 @@
+#include "xmlquery.hpp"
+#include "xml.hpp"
+#include "string.hpp"
+#include "utf.hpp"
+
+XmlQuery compileXmlQuery(const StringView& path) {
+    XmlQuery query;
+
+    int stepStart = 0;
+    for (int i = 0; i <= path.count; ++i) {
+        if (i < path.count && path[i] != '/') {
+            continue;
+        }
+        auto step = substring(path, stepStart, i - stepStart);
+        verify(step.count > 0); // Empty step, e.g. "a//b" or trailing '/'.
+        if (step[0] == '@') {
+            verify(i == path.count); // Attribute must be the last step.
+            query.attributeName = substring(step, 1, step.count - 1);
+            verify(query.attributeName.count > 0);
+        } else {
+            query.steps.push(step);
+        }
+        stepStart = i + 1;
+    }
+
+    verify(query.steps.count > 0);
+    verify(query.attributeName.count > 0);
+    return query;
+}
+
+void runXmlQueries(const StringView& source, const XmlQuery* const* queries, Array<StringView>* results, int count, Arena* arena) {
+    // Number of leading steps matched by the currently open elements.
+    int matchedDepths[16];
+    // Attribute tokens directly follow their StartElement, so a query collects them until
+    // the next token of another type.
+    bool collecting[16];
+    verify(count <= (int)_countof(matchedDepths));
+    for (int i = 0; i < count; ++i) {
+        matchedDepths[i] = 0;
+        collecting[i] = false;
+    }
+
+    // Package documents are UTF-8 in practice, others are transcoded into the arena.
+    int bomSize;
+    auto encoding = detectXmlEncoding(source.chars, source.count, &bomSize);
+    StringView text = substring(source, bomSize, source.count - bomSize);
+    if (encoding != TextEncoding::Utf8) {
+        verifyInput(text.count % 2 == 0, FailureKind::MalformedXml, "UTF-16 document has an odd number of bytes");
+        int unitCount = text.count / 2;
+        auto utf8 = arena->allocateString(utf16ToUtf8MaxSize(unitCount));
+        utf8.count = utf16BytesToUtf8(text.chars, unitCount, encoding == TextEncoding::Utf16BE, utf8.chars);
+        text = utf8;
+    }
+
+    XmlToken token;
+    XmlParser parser;
+    parser.init(text);
+    // Names of the open elements, to check end tags and that the document isn't cut off.
+    SmallArray<StringView, 16> openNames;
+
+    bool insideDeclaration = false;
+    while (parser.next(&token)) {
+        if (token.type != XmlTokenType::Attribute) {
+            for (int i = 0; i < count; ++i) {
+                collecting[i] = false;
+            }
+        }
+
+        switch (token.type) {
+            case XmlTokenType::StartDeclaration: {
+                insideDeclaration = true;
+            } break;
+
+            case XmlTokenType::EndDeclaration: {
+                insideDeclaration = false;
+            } break;
+
+            case XmlTokenType::StartElement: {
+                if (openNames.count == openNames.capacity) {
+                    // Grown in the arena, so a malformed document that fails doesn't leave
+                    // it on the heap.
+                    openNames.reserve(openNames.capacity * 2, arena);
+                }
+                openNames.push(token.startElementName);
+                int depth = parser.elementDepth;
+                for (int i = 0; i < count; ++i) {
+                    const auto& steps = queries[i]->steps;
+                    if (matchedDepths[i] != depth - 1 || depth > steps.count) {
+                        continue;
+                    }
+                    const auto& step = steps[depth - 1];
+                    if (step == "*" || step == token.startElementName) {
+                        matchedDepths[i] = depth;
+                        if (depth == steps.count) {
+                            collecting[i] = true;
+                            results[i].push(StringView{});
+                        }
+                    }
+                }
+            } break;
+
+            case XmlTokenType::Attribute: {
+                if (insideDeclaration) {
+                    break;
+                }
+                for (int i = 0; i < count; ++i) {
+                    if (collecting[i] && queries[i]->attributeName == token.attribute.key) {
+                        results[i].last() = decodeXmlEntities(token.attribute.value, arena);
+                    }
+                }
+            } break;
+
+            case XmlTokenType::EndElement: {
+                verifyInput(openNames.count > 0 && openNames.last() == token.endElementName, FailureKind::MalformedXml, "End tag doesn't match start tag");
+                openNames.pop();
+                int depth = parser.elementDepth + 1;
+                for (int i = 0; i < count; ++i) {
+                    if (matchedDepths[i] == depth) {
+                        --matchedDepths[i];
+                    }
+                }
+            } break;
+
+            default: {
+            } break;
+        }
+    }
+
+    verifyInput(openNames.count == 0, FailureKind::MalformedXml, "Element is not closed");
+    parser.destroy();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "common.hpp"
+#include "array.hpp"
+#include "arena.hpp"
+
+// Compiled path query like "package/manifest/item/@href".
+//
+// Steps match element names exactly, starting at the root element; "*" matches any element.
+// The last step selects an attribute. Queries are compiled once and evaluated directly on
+// the token stream by runXmlQueries, so no DOM is built.
+struct XmlQuery {
+    Array<StringView> steps;
+    StringView attributeName;
+};
+
+XmlQuery compileXmlQuery(const StringView& path);
+
+// Evaluates all queries in a single pass over source, appending to results[i] for queries[i].
+// Every matched element produces exactly one result (empty if the attribute is missing),
+// so results of queries that share an element path line up by index. Results point into
+// source, or into arena when they had entity references to decode or source was UTF-16.
+void runXmlQueries(const StringView& source, const XmlQuery* const* queries, Array<StringView>* results, int count, Arena* arena);
+
+// Result arrays for runXmlQueries, destroyed when they go out of scope, also when a malformed
+// document fails while they are filled.
+template<int N>
+struct XmlQueryResults {
+    Array<StringView> arrays[N];
+
+    XmlQueryResults() = default;
+    ~XmlQueryResults() {
+        for (auto& array : arrays) {
+            array.destroy();
+        }
+    }
+    XmlQueryResults(const XmlQueryResults&) = delete;
+    XmlQueryResults& operator=(const XmlQueryResults&) = delete;
+    const Array<StringView>& operator[](int i) const { return arrays[i]; }
+};